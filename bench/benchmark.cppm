@@ -0,0 +1,117 @@
+export module bench.harness;
+
+import std;
+import nlohmann.json;
+
+export {
+    // Keeps the compiler from throwing away a computation whose result isn't used otherwise
+    template <typename T>
+    requires std::is_trivially_copyable_v<T>
+    void doNotOptimize(const T& value) {
+        static volatile std::byte sink;
+        sink = std::bit_cast<std::array<std::byte, sizeof(T)>>(value)[0];
+    }
+
+    struct BenchmarkOptions {
+        std::chrono::milliseconds minTime {500};
+        std::size_t minSamples = 10;
+        // Only the benchmarks which names contain it are run
+        std::string filter;
+    };
+
+    struct BenchmarkResult {
+        std::string name;
+        std::size_t iterations;
+        // Per iteration
+        double minNs, medianNs, meanNs, maxNs;
+        // Items (bytes, pixels, objects) processed by an iteration, to report the throughput
+        std::size_t itemsPerIteration;
+        std::string itemsName;
+    };
+
+    class BenchmarkRunner {
+    public:
+        explicit BenchmarkRunner(BenchmarkOptions options) : m_options{std::move(options)} {}
+
+        // Runs fn repeatedly in samples of several iterations, every sample is long enough to be measured precisely.
+        void run(std::string name, std::invocable auto&& fn, std::size_t itemsPerIteration = 0, std::string itemsName = {});
+
+        [[nodiscard]] std::span<const BenchmarkResult> results() const noexcept { return m_results; }
+        [[nodiscard]] nlohmann::json toJson(nlohmann::json context) const;
+
+    private:
+        void addResult(std::string name, std::vector<double> sampleNs, std::size_t iterationsPerSample, std::size_t itemsPerIteration, std::string itemsName);
+
+        BenchmarkOptions m_options;
+        std::vector<BenchmarkResult> m_results;
+    };
+}
+
+
+// Implementation
+using Clock = std::chrono::steady_clock;
+
+void BenchmarkRunner::run(std::string name, std::invocable auto&& fn, std::size_t itemsPerIteration, std::string itemsName) {
+    if (!m_options.filter.empty() && !name.contains(m_options.filter))
+        return;
+
+    std::cerr << name << "... " << std::flush;
+
+    // Warm-up: caches, lazily loaded data and the thread pool; it also tells how many iterations a sample needs
+    constexpr auto minSampleTime = std::chrono::microseconds{200};
+    const auto warmupBegin = Clock::now();
+    fn();
+    const auto warmupTime = std::max<Clock::duration>(Clock::now() - warmupBegin, Clock::duration{1});
+    const auto iterationsPerSample = static_cast<std::size_t>(std::max<Clock::rep>(1, minSampleTime / warmupTime));
+
+    std::vector<double> sampleNs;
+    const auto begin = Clock::now();
+    while (sampleNs.size() < m_options.minSamples || Clock::now() - begin < m_options.minTime) {
+        const auto sampleBegin = Clock::now();
+        for (std::size_t i = 0; i < iterationsPerSample; ++i)
+            fn();
+        sampleNs.push_back(std::chrono::duration<double, std::nano>{Clock::now() - sampleBegin}.count() / iterationsPerSample);
+    }
+
+    addResult(std::move(name), std::move(sampleNs), iterationsPerSample, itemsPerIteration, std::move(itemsName));
+    std::cerr << std::format("{:.3f} ms\n", m_results.back().medianNs * 1e-6);
+}
+
+void BenchmarkRunner::addResult(std::string name, std::vector<double> sampleNs, std::size_t iterationsPerSample, std::size_t itemsPerIteration, std::string itemsName) {
+    std::ranges::sort(sampleNs);
+    m_results.push_back({
+        .name = std::move(name),
+        .iterations = sampleNs.size() * iterationsPerSample,
+        .minNs = sampleNs.front(),
+        .medianNs = sampleNs[sampleNs.size() / 2],
+        .meanNs = std::ranges::fold_left(sampleNs, 0.0, std::plus{}) / sampleNs.size(),
+        .maxNs = sampleNs.back(),
+        .itemsPerIteration = itemsPerIteration,
+        .itemsName = std::move(itemsName),
+    });
+}
+
+nlohmann::json BenchmarkRunner::toJson(nlohmann::json context) const {
+    auto benchmarks = nlohmann::json::array();
+    for (const auto& result : m_results) {
+        nlohmann::json entry = {
+            {"name", result.name},
+            {"iterations", result.iterations},
+            {"min_ns", result.minNs},
+            {"median_ns", result.medianNs},
+            {"mean_ns", result.meanNs},
+            {"max_ns", result.maxNs},
+        };
+        if (result.itemsPerIteration != 0) {
+            entry["items_per_iteration"] = result.itemsPerIteration;
+            entry["items"] = result.itemsName;
+            entry["items_per_second"] = result.itemsPerIteration / (result.medianNs * 1e-9);
+        }
+        benchmarks.push_back(std::move(entry));
+    }
+
+    return {
+        {"context", std::move(context)},
+        {"benchmarks", std::move(benchmarks)},
+    };
+}
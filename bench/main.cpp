@@ -0,0 +1,200 @@
+#include <argparse/argparse.hpp>
+
+import std;
+import nlohmann.json;
+import thread_pool;
+import engine.bounding_box;
+
+import Gromada.GameResources;
+import Gromada.GraphicsDecoder;
+import Gromada.Map;
+import Gromada.MapRenderer;
+import Gromada.SoftwareRenderer;
+
+import bench.harness;
+import bench.synthetic_resources;
+
+// Measures the decoder alone, without any writes to a framebuffer
+struct CountingVisitor {
+    std::size_t& numPixels;
+
+    ClippingInfo begin_image(BoundingBox source_rect) { return {source_rect, source_rect}; }
+    void set_cursor(int, int) {}
+    void advance_cursor(int count) { numPixels += count; }
+    void draw_pixels_shadow(int count) { numPixels += count; }
+    // Runs could be empty in the file data or after clipping
+    void draw_pixels(std::span<const CompressedColor> colors) { numPixels += colors.size() + (colors.empty() ? 0 : colors.front().r); }
+    void draw_pixels_indexed(std::span<const IndexedColor> colors) { numPixels += colors.size() + (colors.empty() ? 0 : std::to_integer<std::size_t>(colors.front())); }
+    void draw_pixels_repeat(int count, IndexedColor color) { numPixels += count + std::to_integer<std::size_t>(color); }
+    void draw_pixels_repeat(int count, CompressedColor color) { numPixels += count + color.r; }
+    void draw_pixels_light(int count, std::uint8_t r, std::uint8_t g, std::uint8_t b) { numPixels += count + r + g + b; }
+    void draw_pixels_alpha_blend(std::uint8_t alpha, std::span<const IndexedColor> colors) { numPixels += colors.size() + alpha; }
+};
+static_assert(DecoderVisitor<CountingVisitor>);
+
+std::vector<const VidGraphics*> graphicsOfFormat(const GameResources& resources, std::uint8_t format) {
+    std::vector<const VidGraphics*> result;
+    for (const auto& vid : resources.vids()) {
+        if (std::holds_alternative<Vid::Graphics>(vid.graphicsData) && vid.graphicsHeader().dataFormat == format && vid.graphicsHeader().numOfFrames > 0)
+            result.push_back(&vid.graphics());
+    }
+    return result;
+}
+
+std::size_t countPixels(std::span<const VidGraphics* const> graphics) {
+    return std::ranges::fold_left(graphics, std::size_t{0}, [](std::size_t sum, const VidGraphics* vidGraphics) {
+        return sum + vidGraphics->frames.size() * vidGraphics->width * vidGraphics->height;
+    });
+}
+
+void runDecodeBenchmarks(BenchmarkRunner& runner, const GameResources& resources) {
+    for (const auto format : syntheticFormats) {
+        const auto graphics = graphicsOfFormat(resources, format);
+        if (graphics.empty())
+            continue;
+
+        const auto numPixels = countPixels(graphics);
+        runner.run(std::format("DecodeFrame/format{}", format), [&] {
+            std::size_t checksum = 0;
+            for (const auto* vidGraphics : graphics) {
+                for (const auto& frame : vidGraphics->frames)
+                    DecodeFrame(frame, CountingVisitor{checksum});
+            }
+            doNotOptimize(checksum);
+        }, numPixels, "pixels");
+
+        // Every sprite is drawn in the middle of the framebuffer, and once more partially clipped by its corner
+        const int maxWidth = std::ranges::max(graphics | std::views::transform([](const VidGraphics* g) { return static_cast<int>(g->width); }));
+        const int maxHeight = std::ranges::max(graphics | std::views::transform([](const VidGraphics* g) { return static_cast<int>(g->height); }));
+        PixelBuffer framebuffer {maxWidth * 2, maxHeight * 2};
+        runner.run(std::format("DrawSprite/format{}", format), [&] {
+            for (const auto* vidGraphics : graphics) {
+                for (const auto& frame : vidGraphics->frames) {
+                    DrawSprite(frame, maxWidth - frame.width() / 2, maxHeight - frame.height() / 2, framebuffer);
+                    DrawSprite(frame, -frame.width() / 2, -frame.height() / 2, framebuffer);
+                }
+            }
+            doNotOptimize(framebuffer.pixels()[framebuffer.pixels().size() / 2]);
+        }, numPixels + numPixels / 4, "pixels");
+    }
+}
+
+void runRenderBenchmarks(BenchmarkRunner& runner, const GameResources& resources, const Map& viewportMap, const Map& largeMap) {
+    const auto numPixels = static_cast<std::size_t>(viewportMap.header.width) * viewportMap.header.height;
+    const auto viewportName = std::format("{}x{}", viewportMap.header.width, viewportMap.header.height);
+
+    ThreadPool singleThread {0};
+    runner.run("RenderViewport/" + viewportName + "/single_thread", [&] {
+        doNotOptimize(renderMap(resources, viewportMap, 1, singleThread).pixels().front());
+    }, numPixels, "pixels");
+    runner.run("RenderViewport/" + viewportName + "/parallel", [&] {
+        doNotOptimize(renderMap(resources, viewportMap, 1).pixels().front());
+    }, numPixels, "pixels");
+
+    runner.run(std::format("RenderMap/{}x{}/scale4", largeMap.header.width, largeMap.header.height), [&] {
+        doNotOptimize(renderMap(resources, largeMap, 4).pixels().front());
+    }, static_cast<std::size_t>(largeMap.header.width) * largeMap.header.height, "pixels");
+}
+
+void runResourcesBenchmarks(BenchmarkRunner& runner, const std::filesystem::path& resourcesPath, const std::filesystem::path& cachePath) {
+    const auto fileSize = static_cast<std::size_t>(std::filesystem::file_size(resourcesPath));
+    runner.run("GameResources/eager", [&] {
+        const GameResources resources {resourcesPath, {.graphicsLoading = GraphicsLoading::Eager}};
+        doNotOptimize(resources.vids().size());
+    }, fileSize, "bytes");
+    runner.run("GameResources/lazy", [&] {
+        const GameResources resources {resourcesPath, {.graphicsLoading = GraphicsLoading::Lazy}};
+        doNotOptimize(resources.vids().size());
+    }, fileSize, "bytes");
+
+    // The first construction writes the cache, so it's measured by the warm-up and not by the samples
+    std::filesystem::remove(cachePath);
+    runner.run("GameResources/cached", [&] {
+        const GameResources resources {resourcesPath, {.cachePath = cachePath}};
+        doNotOptimize(resources.vids().size());
+    }, fileSize, "bytes");
+}
+
+void runMapBenchmarks(BenchmarkRunner& runner, const GameResources& resources, const Map& map, const std::filesystem::path& mapPath) {
+    saveMap(resources.vids(), map, mapPath);
+
+    const auto name = std::format("{}x{}", map.header.width, map.header.height);
+    runner.run("loadMap/" + name, [&] {
+        doNotOptimize(loadMap(resources.vids(), mapPath).objects.size());
+    }, map.objects.size(), "objects");
+    runner.run("serializeMap/" + name, [&] {
+        doNotOptimize(serializeMap(resources.vids(), map).size());
+    }, map.objects.size(), "objects");
+    runner.run("saveMap/" + name, [&] {
+        saveMap(resources.vids(), map, mapPath);
+    }, map.objects.size(), "objects");
+}
+
+int main(int argc, char* argv[]) {
+    argparse::ArgumentParser arguments{"GromadaBench"};
+    arguments.add_argument("--data")
+        .default_value((std::filesystem::temp_directory_path() / "gromada_bench").string())
+        .help("directory for the generated resources and maps");
+    arguments.add_argument("--seed")
+        .default_value(1u)
+        .scan<'u', unsigned>();
+    arguments.add_argument("--filter")
+        .default_value(std::string{})
+        .help("runs only the benchmarks which names contain the string");
+    arguments.add_argument("--min_time")
+        .default_value(500)
+        .scan<'i', int>()
+        .help("minimal time of a benchmark, in milliseconds");
+    arguments.add_argument("--out")
+        .help("a .json file for the results, they're printed to stdout otherwise");
+
+    try {
+        arguments.parse_args(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << '\n' << arguments;
+        return 1;
+    }
+
+    try {
+        const std::filesystem::path dataPath {arguments.get<std::string>("--data")};
+        const auto seed = arguments.get<unsigned>("--seed");
+        std::filesystem::create_directories(dataPath);
+
+        const auto resourcesPath = dataPath / "fw.res";
+        writeSyntheticResources(resourcesPath, {.seed = seed});
+        const GameResources resources {resourcesPath, {.graphicsLoading = GraphicsLoading::Eager}};
+        const auto viewportMap = makeSyntheticMap(resources.vids(), {.seed = seed, .width = 1920, .height = 1080});
+        const auto largeMap = makeSyntheticMap(resources.vids(), {.seed = seed, .width = 8192, .height = 8192});
+
+        BenchmarkRunner runner {{
+            .minTime = std::chrono::milliseconds{arguments.get<int>("--min_time")},
+            .filter = arguments.get<std::string>("--filter"),
+        }};
+        runDecodeBenchmarks(runner, resources);
+        runRenderBenchmarks(runner, resources, viewportMap, largeMap);
+        runResourcesBenchmarks(runner, resourcesPath, dataPath / "fw.res.cache");
+        runMapBenchmarks(runner, resources, viewportMap, dataPath / "viewport.map");
+        runMapBenchmarks(runner, resources, largeMap, dataPath / "large.map");
+
+        const auto report = runner.toJson({
+            {"seed", seed},
+            {"threads", ThreadPool::defaultThreadCount() + 1},
+            {"time", std::format("{:%FT%TZ}", std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now()))},
+        }).dump(2);
+
+        if (const auto outPath = arguments.present<std::string>("--out")) {
+            std::ofstream stream {*outPath};
+            stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+            stream << report << '\n';
+        } else {
+            std::cout << report << '\n';
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,343 @@
+module;
+#include <cassert>
+
+export module bench.synthetic_resources;
+
+import std;
+import utils;
+import Gromada.GraphicsFormat;
+import Gromada.Map;
+import Gromada.ResourceReader;
+import Gromada.Resources;
+
+// Deterministic stand-ins of the game's files, so the benchmarks don't need the original data.
+// The same seed gives byte-identical files on every platform: only the generator's raw output is used, not the distributions.
+export {
+    // Graphics formats the decoder supports, a sprite of every one of them is generated
+    constexpr auto syntheticFormats = std::to_array<std::uint8_t>({0, 2, 3, 4, 6, 8});
+
+    struct SyntheticResourcesOptions {
+        std::uint32_t seed = 1;
+        int spriteWidth = 96;
+        int spriteHeight = 64;
+        int numFrames = 8;
+        int spritesPerFormat = 2;
+    };
+
+    // Writes fw.res with spritesPerFormat objects for every format from syntheticFormats, and a terrain tile
+    void writeSyntheticResources(const std::filesystem::path& path, const SyntheticResourcesOptions& options = {});
+
+    struct SyntheticMapOptions {
+        std::uint32_t seed = 1;
+        int width = 1920;
+        int height = 1080;
+        // Per 64x64 block of the map, besides the terrain which covers the whole map
+        float objectsDensity = 1.0f;
+    };
+
+    // Map of the resources written by writeSyntheticResources
+    Map makeSyntheticMap(std::span<const Vid> vids, const SyntheticMapOptions& options = {});
+}
+
+
+// Implementation
+namespace {
+    constexpr std::uint8_t terrainFormat = 0;
+    constexpr std::uint8_t staticBehavior = 1;
+    constexpr std::uint8_t unitBehavior = 2;
+
+    class Random {
+    public:
+        explicit Random(std::uint32_t seed) : m_engine{seed} {}
+
+        // In [0, bound)
+        int operator()(int bound) { return static_cast<int>(m_engine() % static_cast<std::uint32_t>(bound)); }
+        int operator()(int min, int max) { return min + (*this)(max - min + 1); }
+        std::byte byte() { return static_cast<std::byte>(m_engine()); }
+
+    private:
+        std::mt19937 m_engine;
+    };
+
+    class ByteWriter {
+    public:
+        template <typename T>
+        requires std::is_trivially_copyable_v<T>
+        void write(T value) {
+            from_little_endian(value);
+            const auto bytes = std::bit_cast<std::array<std::byte, sizeof(T)>>(value);
+            m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+        }
+
+        template <typename Layout>
+        void write_packed(const typename Layout::Type& value) {
+            std::array<std::byte, Layout::size> bytes;
+            Layout::pack(value, bytes);
+            m_data.insert(m_data.end(), bytes.begin(), bytes.end());
+        }
+
+        void write_bytes(std::span<const std::byte> bytes) { m_data.insert(m_data.end(), bytes.begin(), bytes.end()); }
+
+        [[nodiscard]] std::size_t size() const noexcept { return m_data.size(); }
+        [[nodiscard]] std::span<const std::byte> data() const noexcept { return m_data; }
+
+    private:
+        std::vector<std::byte> m_data;
+    };
+
+    // Row-compressed frames are shaped as ellipses, like the most of the game's sprites, so both skips and pixel runs are there
+    std::pair<int, int> ellipseSpan(int width, int height, int y) {
+        const float dy = (y + 0.5f) / height * 2.0f - 1.0f;
+        const int halfWidth = static_cast<int>(width * 0.5f * std::sqrt(std::max(0.0f, 1.0f - dy * dy)));
+        return {width / 2 - halfWidth, width / 2 + halfWidth};
+    }
+
+    // Splits [0, length) into runs of random size up to maxCount
+    void forEachRun(Random& random, int length, int maxCount, std::invocable<int> auto&& fn) {
+        for (int x = 0; x < length;) {
+            const int count = std::min(random(1, maxCount), length - x);
+            fn(count);
+            x += count;
+        }
+    }
+
+    void writeCompressedRow(ByteWriter& writer, Random& random, std::uint8_t format, int skip, int length) {
+        // Leading transparent part, then the visible runs; the rest of the row after the terminator stays transparent
+        const auto writeSkip = [&](int count) {
+            switch (format) {
+            case 2: writer.write(Mode2ControlWord{.count = static_cast<std::uint8_t>(count), .command = 0}); break;
+            case 3: writer.write(Mode3ControlWord{.count = static_cast<std::uint8_t>(count), .factor = 0}); break;
+            case 4: writer.write(Mode4ControlWord{.count = static_cast<std::uint16_t>(count), .b_factor = 0, .g_factor = 0, .r_factor = 0}); break;
+            case 8: writer.write(Mode8ControlWord{.count = static_cast<std::uint8_t>(count), .opacity = 0}); break;
+            default: std::unreachable();
+            }
+        };
+
+        switch (format) {
+        case 2:
+            forEachRun(random, skip, 63, writeSkip);
+            forEachRun(random, length, 63, [&](int count) {
+                const auto command = static_cast<std::uint8_t>(random(1, 3));
+                writer.write(Mode2ControlWord{.count = static_cast<std::uint8_t>(count), .command = command});
+                for (int i = 0, numColors = command == 2 ? count : command == 3 ? 1 : 0; i < numColors; ++i)
+                    writer.write(random.byte());
+            });
+            writer.write(Mode2ControlWord{});
+            break;
+        case 3:
+            forEachRun(random, skip, 31, writeSkip);
+            forEachRun(random, length, 31, [&](int count) {
+                writer.write(Mode3ControlWord{.count = static_cast<std::uint8_t>(count), .factor = static_cast<std::uint8_t>(random(1, 7))});
+            });
+            writer.write(Mode3ControlWord{});
+            break;
+        case 4:
+            forEachRun(random, skip, 127, writeSkip);
+            forEachRun(random, length, 127, [&](int count) {
+                writer.write(Mode4ControlWord{
+                    .count = static_cast<std::uint16_t>(count),
+                    .b_factor = static_cast<std::uint16_t>(random(8)),
+                    .g_factor = static_cast<std::uint16_t>(random(8)),
+                    .r_factor = static_cast<std::uint16_t>(random(1, 7)),
+                });
+            });
+            writer.write(Mode4ControlWord{});
+            break;
+        case 8:
+            forEachRun(random, skip, 31, writeSkip);
+            forEachRun(random, length, 31, [&](int count) {
+                const auto opacity = static_cast<std::uint8_t>(random(1, 7));
+                writer.write(Mode8ControlWord{.count = static_cast<std::uint8_t>(count), .opacity = opacity});
+                for (int i = 0; i < count; ++i)
+                    writer.write(random.byte());
+            });
+            writer.write(Mode8ControlWord{});
+            break;
+        default:
+            std::unreachable();
+        }
+    }
+
+    std::vector<std::byte> makeFramePayload(Random& random, std::uint8_t format, int width, int height) {
+        ByteWriter writer;
+        switch (format) {
+        case 0:
+            for (int i = 0; i < width * height; ++i)
+                writer.write(random.byte());
+            break;
+        case 6:
+            // Rows aren't terminated, every one is exactly width pixels long; the highest bit of a control byte means repeat
+            for (int y = 0; y < height; ++y) {
+                forEachRun(random, width, 127, [&](int count) {
+                    const bool repeat = random(2) == 0;
+                    writer.write(static_cast<std::uint8_t>(repeat << 7 | count));
+                    for (int i = 0, numColors = repeat ? 1 : count; i < numColors; ++i)
+                        writer.write(static_cast<std::uint16_t>(random(0x8000)));
+                });
+            }
+            break;
+        default: {
+            // A few transparent rows are left out at the top and at the bottom
+            const int startY = height / 8;
+            const int numRows = height - 2 * startY;
+            writer.write(static_cast<std::uint16_t>(startY));
+            writer.write(static_cast<std::uint16_t>(numRows));
+            for (int y = startY; y < startY + numRows; ++y) {
+                const auto [left, right] = ellipseSpan(width, height, y);
+                writeCompressedRow(writer, random, format, left, right - left);
+            }
+        }
+        }
+
+        return {writer.data().begin(), writer.data().end()};
+    }
+
+    void writeVidSection(ByteWriter& file, Random& random, VidProperties properties, std::uint8_t format, int width, int height, int numFrames) {
+        ByteWriter graphics;
+        for (int i = 0; i < 256 * 3; ++i)
+            graphics.write(random.byte());
+        for (int i = 0; i < numFrames; ++i) {
+            const auto payload = makeFramePayload(random, format, width, height);
+            graphics.write(static_cast<std::uint32_t>(payload.size() + 2));
+            graphics.write(std::uint16_t{0xFFFF}); // own data, not a reference to another frame
+            graphics.write_bytes(payload);
+        }
+
+        properties.dataSizeOrNvid = static_cast<std::int32_t>(graphics.size());
+        const VidGraphicsHeader header {
+            .dataFormat = format,
+            .frameDuration = 100,
+            .numOfFrames = static_cast<std::uint16_t>(numFrames),
+            .dataSize = static_cast<std::uint32_t>(graphics.size()),
+            .width = static_cast<std::uint16_t>(width),
+            .height = static_cast<std::uint16_t>(height),
+        };
+
+        // The next section's offset is counted from the field right after the type
+        const auto sectionSize = SectionHeader::size + VidPropertiesLayout::size + VidGraphicsHeaderLayout::size + graphics.size();
+        file.write(SectionType::Vid);
+        file.write(static_cast<std::uint32_t>(sectionSize - 5));
+        file.write(std::uint32_t{1});
+        file.write(std::uint16_t{0});
+        file.write_packed<VidPropertiesLayout>(properties);
+        file.write_packed<VidGraphicsHeaderLayout>(header);
+        file.write_bytes(graphics.data());
+    }
+
+    void writeTilesSection(ByteWriter& file, std::int16_t terrainNvid) {
+        constexpr std::uint32_t numRows = 16;
+        file.write(SectionType::TilesTable);
+        file.write(static_cast<std::uint32_t>(SectionHeader::size + numRows * 16 * sizeof(std::int16_t) - 5));
+        file.write(numRows);
+        file.write(std::uint16_t{0});
+        for (std::uint32_t row = 0; row < numRows; ++row) {
+            for (std::uint32_t column = 0; column < 16; ++column)
+                file.write(static_cast<std::int16_t>(row == column ? terrainNvid : 0));
+        }
+    }
+
+    VidProperties makeProperties(std::string_view name, UnitType unitType, std::uint8_t behave, std::uint8_t zLayer, int numFrames) {
+        VidProperties properties;
+        assert(name.size() < properties.name.size());
+        std::ranges::copy(name, properties.name.begin());
+        properties.unitType = unitType;
+        properties.behave = behave;
+        properties.directionsCount = 1;
+        properties.z_layer = zLayer;
+        properties.animationLengths[std::to_underlying(Action::act_stand)] = static_cast<std::uint8_t>(numFrames);
+        return properties;
+    }
+}
+
+void writeSyntheticResources(const std::filesystem::path& path, const SyntheticResourcesOptions& options) {
+    Random random {options.seed};
+    ByteWriter file;
+
+    const auto numVids = 1 + syntheticFormats.size() * options.spritesPerFormat;
+    file.write(static_cast<std::uint32_t>(numVids + 1)); // and the tiles table
+
+    for (const auto format : syntheticFormats) {
+        for (int i = 0; i < options.spritesPerFormat; ++i) {
+            // Every other sprite is a unit, they're serialized in maps with a bigger payload
+            const bool isUnit = i % 2 == 1;
+            const auto name = std::format("format{}_{}", format, i);
+            const auto properties = makeProperties(name, isUnit ? UnitType::Monster : UnitType::Object, isUnit ? unitBehavior : staticBehavior, 1, options.numFrames);
+            writeVidSection(file, random, properties, format, options.spriteWidth, options.spriteHeight, options.numFrames);
+        }
+    }
+    // Terrain goes last, nvid 0 in the tiles table means no tile
+    writeVidSection(file, random, makeProperties("terrain", UnitType::Terrain, 0, 0, 1), terrainFormat, 64, 32, 1);
+    writeTilesSection(file, static_cast<std::int16_t>(numVids - 1));
+
+    std::ofstream stream {path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc};
+    stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    stream.write(reinterpret_cast<const char*>(file.data().data()), static_cast<std::streamsize>(file.size()));
+}
+
+Map makeSyntheticMap(std::span<const Vid> vids, const SyntheticMapOptions& options) {
+    const auto terrainNvid = std::ranges::find(vids, UnitType::Terrain, &Vid::unitType) - vids.begin();
+    const auto objectNvids = std::views::iota(std::size_t{0}, vids.size())
+        | std::views::filter([&](std::size_t nvid) { return vids[nvid].unitType != UnitType::Terrain; })
+        | std::ranges::to<std::vector>();
+    if (terrainNvid == std::ssize(vids) || objectNvids.empty())
+        throw std::invalid_argument("makeSyntheticMap: resources should have a terrain and some objects");
+
+    Random random {options.seed};
+    Map map {.header = {
+        .width = static_cast<std::uint32_t>(options.width),
+        .height = static_cast<std::uint32_t>(options.height),
+        .observerX = static_cast<std::int16_t>(options.width / 2),
+        .observerY = static_cast<std::int16_t>(options.height / 2),
+    }};
+
+    std::uint32_t nextId = 1;
+    const auto& terrainHeader = vids[terrainNvid].graphicsHeader();
+    for (int y = terrainHeader.height / 2; y < options.height + terrainHeader.height; y += terrainHeader.height) {
+        for (int x = terrainHeader.width / 2; x < options.width + terrainHeader.width; x += terrainHeader.width) {
+            map.objects.push_back({
+                .nvid = static_cast<std::uint16_t>(terrainNvid),
+                .x = static_cast<std::int16_t>(x),
+                .y = static_cast<std::int16_t>(y),
+                .z = 0,
+                .direction = 0,
+                .id = nextId++,
+            });
+        }
+    }
+
+    const auto numObjects = static_cast<std::size_t>(options.objectsDensity * options.width * options.height / (64 * 64));
+    std::vector<std::uint32_t> unitIds;
+    for (std::size_t i = 0; i < numObjects; ++i) {
+        const auto nvid = objectNvids[random(static_cast<int>(objectNvids.size()))];
+        GameObject object {
+            .nvid = static_cast<std::uint16_t>(nvid),
+            .x = static_cast<std::int16_t>(random(options.width)),
+            .y = static_cast<std::int16_t>(random(options.height)),
+            .z = static_cast<std::int16_t>(random(4) == 0 ? random(1, 32) : 0),
+            .direction = static_cast<std::uint8_t>(random(256)),
+            .payload = {.hp = static_cast<std::uint8_t>(random(1, 255))},
+            .id = nextId++,
+        };
+
+        if (vids[nvid].behave == unitBehavior) {
+            object.payload.army = static_cast<std::uint8_t>(random(2));
+            object.payload.items = std::views::iota(0, random(3)) | std::views::transform([&](int) { return static_cast<std::int16_t>(random(100)); }) | std::ranges::to<std::vector>();
+            object.payload.commands = std::views::iota(0, random(3)) | std::views::transform([&](int) {
+                return ObjectCommand{.command = Action::act_go, .p1 = static_cast<std::uint32_t>(random(options.width)), .p2 = static_cast<std::uint32_t>(random(options.height))};
+            }) | std::ranges::to<std::vector>();
+            unitIds.push_back(object.id);
+        }
+
+        map.objects.push_back(std::move(object));
+    }
+
+    // Squads can't be empty, an empty one would be read as the end of the list
+    for (std::size_t i = 0; i < map.armies.size(); ++i) {
+        auto& army = map.armies[i];
+        army = {.a = 0, .b = 0, .c = 0, .flagman_id = 0};
+        for (std::size_t first = i * 8; first < unitIds.size(); first += map.armies.size() * 8)
+            army.squads.emplace_back(unitIds.begin() + first, unitIds.begin() + std::min(first + 8, unitIds.size()));
+    }
+
+    return map;
+}
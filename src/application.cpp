@@ -15,6 +15,7 @@ import std;
 
 import application.model;
 import application.view_model;
+import profiler;
 
 import Gromada.DataExporters;
 
@@ -27,7 +28,7 @@ export class Application {
 public:
     Application(const std::vector<std::string>& args)
 	    : m_arguments{"Gromada viewer"}
-        , m_model{ (parseArguments( args ), m_arguments.get<std::filesystem::path>( "res_path" ))}
+        , m_model{ (parseArguments( args ), m_arguments.get<std::filesystem::path>( "res_path" )), GameResourcesOptions{.cachePath = m_arguments.present<std::filesystem::path>("--resources_cache")}}
 		, m_viewModel{ m_model }
     {
 		if (auto arg = m_arguments.present<std::filesystem::path>("--export_csv")) {
@@ -35,7 +36,8 @@ public:
 			stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
 
 			const auto vids = m_model.get<const GameResources>().vids();
-			ExportVidsToCsv(vids, stream);
+			const auto columns = m_arguments.present("--csv_columns").transform(parseVidCsvColumns).value_or(allVidCsvColumns);
+			ExportVidsToCsv(vids, stream, columns);
 		}
 
 		if (auto arg = m_arguments.present<std::filesystem::path>("--map")) {
@@ -46,8 +48,19 @@ public:
     }
 
 	void on_frame() {
-		m_model.progress();
-		m_viewModel.updateUI();
+		{
+			// Between the frames, so the world isn't changed while the UI refers to its entities
+			const ProfileScope scope{"Map loading finish"};
+			m_model.finishMapLoading();
+		}
+		{
+			const ProfileScope scope{"Model::progress"};
+			m_model.progress();
+		}
+		{
+			const ProfileScope scope{"ViewModel::updateUI"};
+			m_viewModel.updateUI();
+		}
 
         //ImGui::ShowDemoWindow();
 
@@ -59,10 +72,17 @@ public:
 			},
     	};
     	pass.swapchain = sglue_swapchain();
-    	sg_begin_pass(&pass);
-    	simgui_render();
-    	sg_end_pass();
-    	sg_commit();
+    	{
+    		const ProfileScope scope{"Render pass"};
+    		sg_begin_pass(&pass);
+    		{
+    			const ProfileScope imguiScope{"ImGui render"};
+    			simgui_render();
+    		}
+    		sg_end_pass();
+    		sg_commit();
+    	}
+    	Profiler::shared().endFrame();
 
 #ifndef __EMSCRIPTEN__
     	using namespace std::chrono_literals;
@@ -126,6 +146,13 @@ private:
 			.action(to_writtable_path)
 			.help("Export CSV file with vids data");
 
+    	m_arguments.add_argument("--csv_columns")
+			.help("comma-separated columns of the exported CSV, like name,unitType,numOfFrames,width,height; all of them by default");
+
+    	m_arguments.add_argument("--resources_cache")
+			.action(to_writtable_path)
+			.help("a path to the cache of parsed resources, speeds up the next launches");
+
     	m_arguments.add_argument("--map")
 			.action(to_readable_path)
 			.help("a path to a .map file");
@@ -11,6 +11,7 @@ import Gromada.Map;
 import engine.bounding_box;
 import engine.level_renderer;
 import engine.audio;
+import thread_pool;
 
 export import Gromada.GameResources;
 
@@ -47,8 +48,19 @@ export struct EditorComponents {
 
 export class Model : public flecs::world {
 public:
-	explicit Model(std::filesystem::path path)
-		: flecs::world{create_world(std::move(path))} {}
+	explicit Model(std::filesystem::path path, const GameResourcesOptions& resourcesOptions = {})
+		: flecs::world{create_world(std::move(path), resourcesOptions)} {}
+
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
+
+	// Loading threads use the game resources of the world
+	~Model() {
+		cancelMapLoading();
+		prefetchMaps({});
+		for (auto& loading : m_cancelledMapLoadings)
+			loading.wait();
+	}
 
     void newMap(VidRef vid, int width, int height) {
 	    const auto activeLevel = this->component<ActiveLevel>();
@@ -96,25 +108,83 @@ public:
 
     // TODO: "this->" leaved to remember that it will be a free function soon
 	void loadMap(std::filesystem::path path) {
-		const auto& gameResources = this->get<const GameResources>();
-		const auto map = ::loadMap(gameResources.vids(), path);
-	    const auto activeLevel = this->component<ActiveLevel>();
-	    this->delete_with(flecs::ChildOf, activeLevel);
+		cancelMapLoading();
+		auto map = ::loadMap(this->get<const GameResources>().vids(), path);
+		applyMap(std::move(map), std::move(path));
+	}
 
-	    for (const auto& obj : map.objects) {
-	        this->entity()
-                .emplace<VidRef>(gameResources.getVid(obj.nvid))
-	            .set<Transform, Local>({.x = obj.x, .y = obj.y, .z = obj.z, .direction = obj.direction})
-	            .set<GameObject::Payload>(obj.payload)
-	            .set<EditorOrdering>({.uid = obj.id, .index = static_cast<std::uint16_t>(&obj - map.objects.data())})
-                .child_of(activeLevel);
-	    }
+	struct MapLoading {
+		std::filesystem::path path;
+		std::shared_ptr<MapLoadProgress> progress;
+		std::future<Map> result;
+	};
+
+	// The map is parsed by a worker thread, and replaces the active level in finishMapLoading() once it's ready.
+	// Unfinished loading of another map is cancelled
+	void loadMapAsync(std::filesystem::path path) {
+		cancelMapLoading();
+		m_mapLoadingError.clear();
+
+		if (const auto it = std::ranges::find(m_prefetchedMaps, path, &MapLoading::path); it != m_prefetchedMaps.end()) {
+			m_mapLoading = std::move(*it);
+			m_prefetchedMaps.erase(it);
+		} else {
+			m_mapLoading = startMapLoading(std::move(path));
+		}
+	}
 
-	    activeLevel.set<MapHeaderRawData>(map.header);
-        activeLevel.set<Path>(std::move(path));
-	    activeLevel.set<Armies>(std::move(map.armies));
+	void cancelMapLoading() {
+		if (!m_mapLoading)
+			return;
+
+		cancel(std::move(*m_mapLoading));
+		m_mapLoading.reset();
+	}
+
+	// Starts loading of the maps which are likely to be chosen next, so loadMapAsync() of them is finished at once.
+	// Prefetched maps which aren't in the list anymore are dropped
+	void prefetchMaps(std::span<const std::filesystem::path> paths) {
+		std::erase_if(m_prefetchedMaps, [&](MapLoading& loading) {
+			if (std::ranges::find(paths, loading.path) != paths.end())
+				return false;
+
+			cancel(std::move(loading));
+			return true;
+		});
+
+		// Without the workers maps would be loaded right here, slowing the frame down
+		if (ThreadPool::shared().size() == 0)
+			return;
+
+		for (const auto& path : paths) {
+			const bool isLoading = (m_mapLoading && m_mapLoading->path == path) || std::ranges::find(m_prefetchedMaps, path, &MapLoading::path) != m_prefetchedMaps.end();
+			if (!isLoading)
+				m_prefetchedMaps.push_back(startMapLoading(path));
+		}
+	}
+
+	// Should be called between the frames, swaps the loaded map into the active level
+	void finishMapLoading() {
+		const auto isReady = [](const std::future<Map>& future) { return future.wait_for(std::chrono::seconds{0}) == std::future_status::ready; };
+		std::erase_if(m_cancelledMapLoadings, isReady);
+
+		if (!m_mapLoading || !isReady(m_mapLoading->result))
+			return;
+
+		auto loading = std::move(*m_mapLoading);
+		m_mapLoading.reset();
+		try {
+			applyMap(loading.result.get(), std::move(loading.path));
+		}
+		catch (const std::exception& e) {
+			m_mapLoadingError = std::format("Can't load {}: {}", loading.path.string(), e.what());
+		}
 	}
 
+	[[nodiscard]] const MapLoading* mapLoading() const noexcept { return m_mapLoading ? &*m_mapLoading : nullptr; }
+	// Of the last loading, empty if it has succeeded
+	[[nodiscard]] const std::string& mapLoadingError() const noexcept { return m_mapLoadingError; }
+
     static GameObject makeGameObject(const VidRef& vid, const Transform& transform, const GameObject::Payload* payload, std::uint32_t id) {
 	    assert(transform.x > std::numeric_limits<std::int16_t>::min() && transform.y > std::numeric_limits<std::int16_t>::min() && transform.z > std::numeric_limits<std::int16_t>::min());
 	    assert(transform.x < std::numeric_limits<std::int16_t>::max() && transform.y < std::numeric_limits<std::int16_t>::max() && transform.z < std::numeric_limits<std::int16_t>::max());
@@ -209,6 +279,89 @@ public:
 	}
 
 private:
+	MapLoading startMapLoading(std::filesystem::path path) {
+		auto progress = std::make_shared<MapLoadProgress>();
+		auto result = ThreadPool::shared().submit([vids = this->get<const GameResources>().vids(), path, progress] {
+			return ::loadMap(vids, path, progress.get());
+		});
+		return MapLoading{std::move(path), std::move(progress), std::move(result)};
+	}
+
+	void cancel(MapLoading&& loading) {
+		loading.progress->cancelled = true;
+		m_cancelledMapLoadings.push_back(std::move(loading.result));
+	}
+
+	void applyMap(Map map, std::filesystem::path path) {
+		const auto& gameResources = this->get<const GameResources>();
+	    const auto activeLevel = this->component<ActiveLevel>();
+	    this->delete_with(flecs::ChildOf, activeLevel);
+
+	    instantiateObjects(gameResources, map.objects, activeLevel);
+
+	    activeLevel.set<MapHeaderRawData>(map.header);
+        activeLevel.set<Path>(std::move(path));
+	    activeLevel.set<Armies>(std::move(map.armies));
+	}
+
+    flecs::entity instantiateObject(const GameResources& gameResources, const GameObject& obj, std::uint32_t index, flecs::entity level) {
+        return this->entity()
+            .emplace<VidRef>(gameResources.getVid(obj.nvid))
+            .set<Transform, Local>({.x = obj.x, .y = obj.y, .z = obj.z, .direction = obj.direction})
+            .set<GameObject::Payload>(obj.payload)
+            .set<EditorOrdering>({.uid = obj.id, .index = index})
+            .child_of(level);
+    }
+
+    // All the objects of a map end up with the same components, so only the first one is created the regular way,
+    // letting the observers add theirs. The others are bulk-created right in its table and filled column by column,
+    // so they neither move between tables nor trigger the observers. The observers' work is done here instead:
+    // animations get their initial frames, and the linked objects are created in a single deferred batch.
+    void instantiateObjects(const GameResources& gameResources, std::span<const GameObject> objects, flecs::entity level) {
+        if (objects.empty())
+            return;
+
+        const auto first = instantiateObject(gameResources, objects.front(), 0, level);
+        const auto rest = objects.subspan(1);
+        if (rest.empty())
+            return;
+
+        ecs_world_t* world = this->c_ptr();
+        ecs_bulk_desc_t desc {};
+        desc.count = static_cast<std::int32_t>(rest.size());
+        desc.table = ecs_get_table(world, first);
+        // Returned array is only valid until the next operation on the world
+        const auto* created = ecs_bulk_init(world, &desc);
+        const std::vector<flecs::entity_t> entities(created, created + rest.size());
+
+        const auto row = ECS_RECORD_TO_ROW(ecs_record_find(world, entities.front())->row);
+        const auto column = [&](flecs::id_t id) {
+            void* result = ecs_table_get_id(world, desc.table, id, row);
+            assert(result && "all the map objects should have the same components");
+            return result;
+        };
+        auto* vids = static_cast<VidRef*>(column(this->id<VidRef>()));
+        auto* transforms = static_cast<Transform*>(column(this->pair<Transform, Local>()));
+        auto* payloads = static_cast<GameObject::Payload*>(column(this->id<GameObject::Payload>()));
+        auto* orderings = static_cast<EditorOrdering*>(column(this->id<EditorOrdering>()));
+        auto* animations = static_cast<AnimationComponent*>(column(this->id<AnimationComponent>()));
+
+        for (std::size_t i = 0; i < rest.size(); ++i) {
+            const auto& obj = rest[i];
+            vids[i] = gameResources.getVid(obj.nvid);
+            transforms[i] = {.x = obj.x, .y = obj.y, .z = obj.z, .direction = obj.direction};
+            payloads[i] = obj.payload;
+            orderings[i] = {.uid = obj.id, .index = static_cast<std::uint32_t>(i + 1)};
+            animations[i].current_frame = initialAnimationFrame(entities[i]);
+        }
+
+        // Table isn't changed until the end of the deferred block, so the columns stay valid
+        this->defer([&] {
+            for (std::size_t i = 0; i < rest.size(); ++i)
+                spawnLinkedObject(flecs::entity{world, entities[i]}, vids[i]);
+        });
+    }
+
     void updateMapBounds(std::ranges::range auto&& entities, MapHeaderRawData& header) {
         const auto map_bounds = std::reduce(entities.begin(), entities.end(), BoundingBox{}, [](BoundingBox bb, flecs::entity obj) {
             const auto& transform = obj.get<Transform, Local>();
@@ -219,6 +372,7 @@ private:
         	auto& transform = obj.get_mut<Transform, Local>();
             transform.x -= map_bounds.left;
             transform.y -= map_bounds.top;
+            obj.modified<Transform, Local>();
         });
 
         header.height = map_bounds.height();
@@ -240,18 +394,18 @@ private:
                 this->entity()
                     .set<VidRef>(vid)
                     .set<Transform, Local>({.x = static_cast<std::int16_t>(i * vid->sizeX + vid->sizeX / 2), .y = static_cast<std::int16_t>(j * vid->sizeY + vid->sizeY / 2), .z = 0, .direction = static_cast<std::uint8_t>(directionsDistribution(rng))})
-                    .set<EditorOrdering>({.uid = 0, .index = static_cast<std::uint16_t>(j * width + i)})
+                    .set<EditorOrdering>({.uid = 0, .index = static_cast<std::uint32_t>(j * width + i)})
                     .child_of(activeLevel);
             }
         }
     }
 
-	flecs::world create_world(std::filesystem::path resourcesPath) {
+	flecs::world create_world(std::filesystem::path resourcesPath, const GameResourcesOptions& resourcesOptions) {
 		flecs::world world{};
         world.import<WorldModule>();
         world.import<EditorComponents>();
 
-        world.emplace<GameResources>(resourcesPath);
+        world.emplace<GameResources>(resourcesPath, resourcesOptions);
         world.emplace<AudioEngine>();
     	world.emplace<GlobalEditorState>();
 
@@ -270,4 +424,10 @@ private:
         return world;
     }
 
+private:
+	std::optional<MapLoading> m_mapLoading;
+	std::vector<MapLoading> m_prefetchedMaps;
+	// They can't be stopped at once, but should be finished before the world is destroyed
+	std::vector<std::future<Map>> m_cancelledMapLoadings;
+	std::string m_mapLoadingError;
 };
\ No newline at end of file
@@ -9,6 +9,7 @@ export module application.view_model;
 import std;
 import imgui_utils;
 import Gromada.DataExporters;
+import Gromada.MapGenerator;
 
 import engine.level_renderer; // For Viewport. Better to split
 
@@ -18,6 +19,7 @@ import :map_selector;
 import :vids_window;
 import :map_properties;
 import :sounds_window;
+import :profiler_window;
 
 export class ViewModel {
 public:
@@ -86,12 +88,17 @@ Controls:
 
 		ImGui::End();
 
+		if (m_showProfiler)
+			m_profilerWindowViewModel.updateUI(&m_showProfiler);
+
 		// ImGui::ShowDemoWindow();
 	}
 
 	void drawMenu() {
 		constexpr const char* ExportPopup = "Export map JSON";
 		constexpr const char* NewMapPopup = "New map";
+		constexpr const char* GenerateMapPopup = "Generate stress map";
+		constexpr const char* SaveErrorPopup = "Map saving failed";
 		const char* openPopup = nullptr;
 
 	    const auto vids = m_model.get<const GameResources>().vids();
@@ -102,6 +109,11 @@ Controls:
 		       openPopup = NewMapPopup;
             }
 
+		    if (ImGui::MenuItem("Generate stress map")) {
+		        openPopup = GenerateMapPopup;
+		        m_generateMapPopupState.error.clear();
+		    }
+
 			if (ImGui::MenuItem("Export map JSON")) {
 				openPopup = ExportPopup;
 				m_savePopupfilenameBuffer.emplace();
@@ -111,8 +123,14 @@ Controls:
 			}
 
 		    if (ImGui::MenuItem("Save map")) {
-		        std::ofstream file {"maps/EXPERIMENTAL_SAVE.map", std::ios_base::out | std::ios_base::binary};
-		        saveMap(vids, m_model.saveMap(), file);
+		        const std::filesystem::path path{"maps/EXPERIMENTAL_SAVE.map"};
+		        try {
+		            std::filesystem::create_directories(path.parent_path());
+		            saveMap(vids, m_model.saveMap(), path);
+		        } catch (const std::exception& e) {
+		            m_saveMapError = e.what();
+		            openPopup = SaveErrorPopup;
+		        }
 		    }
 
 			// TODO: reuse popup from previous item
@@ -134,6 +152,11 @@ Controls:
 		    ImGui::EndMenu();
 		}
 
+		if (ImGui::BeginMenu("Tools")) {
+		    ImGui::MenuItem("Profiler", nullptr, &m_showProfiler);
+		    ImGui::EndMenu();
+		}
+
 		if (openPopup != nullptr) {
 			ImGui::OpenPopup(openPopup);
 		}
@@ -174,6 +197,53 @@ Controls:
                 ImGui::CloseCurrentPopup();
             }
 
+		    ImGui::EndPopup();
+		} else if (ImGui::BeginPopupModal(GenerateMapPopup, nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoCollapse)) {
+		    auto& options = m_generateMapPopupState.options;
+		    // Coordinates of the objects are 16-bit, so is the map size
+		    constexpr int maxMapSize = std::numeric_limits<std::int16_t>::max();
+		    if (ImGui::InputInt("Width", &options.width))
+		        options.width = std::clamp(options.width, 1, maxMapSize);
+		    if (ImGui::InputInt("Height", &options.height))
+		        options.height = std::clamp(options.height, 1, maxMapSize);
+		    ImGui::InputScalar("Seed", ImGuiDataType_U32, &options.seed);
+		    ImGui::Checkbox("Terrain", &options.terrain);
+		    ImGui::SeparatorText("Objects per 256x256 block");
+		    for (const auto unitType : generatedUnitTypes) {
+		        ImGui::InputFloat(to_string(unitType).data(), &options.densities[unitType], 0.25f, 1.0f, "%.2f");
+		    }
+		    ImGui::SliderFloat("Units with commands", &options.commandsProbability, 0.0f, 1.0f);
+		    ImGui::InputText("Save to", &m_generateMapPopupState.path);
+
+		    if (const auto& error = m_generateMapPopupState.error; !error.empty()) {
+		        ImGui::TextColored(ImVec4{1.0f, 0.3f, 0.3f, 1.0f}, "%s", error.c_str());
+		    }
+
+		    if (ImGui::Button("OK", ImVec2(120, 0))) {
+		        // The popup stays open on failure, so the options could be fixed
+		        try {
+		            // The map goes through the file, so it's loaded the same way as the maps it stands in for
+		            saveMap(vids, generateMap(m_model.get<const GameResources>(), options), std::filesystem::path{m_generateMapPopupState.path});
+		            m_model.loadMap(m_generateMapPopupState.path);
+		            m_generateMapPopupState.error.clear();
+		            ImGui::CloseCurrentPopup();
+		        } catch (const std::exception& e) {
+		            m_generateMapPopupState.error = e.what();
+		        }
+		    }
+
+		    ImGui::SameLine();
+		    if (ImGui::Button("Cancel", ImVec2(120, 0))) {
+		        ImGui::CloseCurrentPopup();
+		    }
+
+		    ImGui::EndPopup();
+		} else if (ImGui::BeginPopupModal(SaveErrorPopup, nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoCollapse)) {
+		    ImGui::TextColored(ImVec4{1.0f, 0.3f, 0.3f, 1.0f}, "%s", m_saveMapError.c_str());
+		    if (ImGui::Button("OK", ImVec2(120, 0))) {
+		        ImGui::CloseCurrentPopup();
+		    }
+
 		    ImGui::EndPopup();
 		}
 
@@ -218,9 +288,18 @@ private:
         int selectedTile = 0;
     } m_newMapPopupState;
 
+    struct GenerateMapPopupState {
+        MapGeneratorOptions options;
+        std::string path = "maps/GENERATED.map";
+        std::string error; // of the last attempt
+    } m_generateMapPopupState;
+    std::string m_saveMapError; // shown by the popup after a failed "Save map"
+
 	VidsWindowViewModel m_vidsViewModel{m_model};
 	MapViewModel m_mapViewModel{m_model};
 	MapsSelectorViewModel m_mapsSelectorViewModel{m_model};
     MapPropertiesViewModel m_mapPropertiesViewModel{m_model};
     SoundsWindowViewModel m_soundsViewModel{m_model};
+    ProfilerWindowViewModel m_profilerWindowViewModel;
+    bool m_showProfiler = false;
 };
\ No newline at end of file
@@ -0,0 +1,385 @@
+module;
+#include <argparse/argparse.hpp>
+
+export module batch_modes;
+
+import std;
+import png_writer;
+import thread_pool;
+
+import Gromada.DataExporters;
+import Gromada.GameResources;
+import Gromada.Map;
+import Gromada.MapGenerator;
+import Gromada.MapRenderer;
+import Gromada.SoftwareRenderer;
+
+// Headless mode: renders map previews to PNG files and exits, without creating a window.
+// Returns the process exit code, or nothing if the arguments don't ask for it and the editor should start as usual.
+export std::optional<int> runBatchRender(const std::vector<std::string>& args);
+
+// Headless mode too: generates a big random map (see Gromada.MapGenerator) and saves it, same return value as above
+export std::optional<int> runBatchGenerate(const std::vector<std::string>& args);
+
+// Headless mode too: every map of a directory goes through load, save and load again, and the results are compared.
+// Optionally writes the saved (normalized to the latest version) maps or their JSON. Same return value as above
+export std::optional<int> runBatchValidate(const std::vector<std::string>& args);
+
+
+// Implementation
+namespace {
+	// The resource file and its cache, the same for all the modes
+	void addResourceArguments(argparse::ArgumentParser& arguments) {
+		arguments.add_argument("res_path")
+			.default_value(std::filesystem::current_path().string() + "/fw.res");
+		arguments.add_argument("--resources_cache")
+			.help("a path to the cache of parsed resources, speeds up the next launches");
+	}
+
+	GameResources loadResources(const argparse::ArgumentParser& arguments) {
+		return GameResources{arguments.get<std::string>("res_path"), GameResourcesOptions{
+			.cachePath = arguments.present<std::string>("--resources_cache").transform([](const std::string& path) { return std::filesystem::path{path}; }),
+		}};
+	}
+
+	struct RenderJob {
+		std::filesystem::path map;
+		std::filesystem::path image;
+	};
+
+	// The file itself, or the .map files of a directory in the order of names
+	std::vector<std::filesystem::path> collectMaps(const std::filesystem::path& input) {
+		if (!std::filesystem::is_directory(input))
+			return {input};
+
+		std::vector<std::filesystem::path> maps;
+		for (const auto& entry : std::filesystem::directory_iterator{input}) {
+			if (entry.is_regular_file() && entry.path().extension() == ".map")
+				maps.push_back(entry.path());
+		}
+		std::ranges::sort(maps);
+
+		return maps;
+	}
+
+	// A directory of maps goes to a directory of images with the same names
+	std::vector<RenderJob> collectJobs(const std::filesystem::path& input, const std::filesystem::path& output) {
+		if (!std::filesystem::is_directory(input))
+			return {{input, output}};
+
+		std::filesystem::create_directories(output);
+		return collectMaps(input) | std::views::transform([&](const std::filesystem::path& map) {
+			return RenderJob{map, output / map.filename().replace_extension(".png")};
+		}) | std::ranges::to<std::vector>();
+	}
+
+	enum class ValidationOutput { None, Map, Json };
+
+	struct ValidationJob {
+		std::filesystem::path map;
+		std::filesystem::path output; // empty if nothing is written
+	};
+
+	// Output is always a directory, even for a single map, the written files have the names of the maps
+	std::vector<ValidationJob> collectValidationJobs(const std::filesystem::path& input, const std::optional<std::filesystem::path>& outputDirectory, ValidationOutput output) {
+		if (outputDirectory)
+			std::filesystem::create_directories(*outputDirectory);
+
+		return collectMaps(input) | std::views::transform([&](const std::filesystem::path& map) {
+			if (!outputDirectory)
+				return ValidationJob{map, {}};
+
+			return ValidationJob{map, *outputDirectory / map.filename().replace_extension(output == ValidationOutput::Json ? ".json" : ".map")};
+		}) | std::ranges::to<std::vector>();
+	}
+
+	struct ValidationResult {
+		std::filesystem::path map;
+		std::size_t fileSize = 0;
+		std::chrono::duration<double, std::milli> loadTime {}, saveTime {}, reloadTime {};
+		std::string bytesDifference; // empty if the saved map is identical to the original
+		std::vector<std::string> differences; // between the loaded and reloaded maps
+		std::string error;
+	};
+
+	std::vector<std::byte> readFile(const std::filesystem::path& path) {
+		std::ifstream stream{path, std::ios_base::in | std::ios_base::binary};
+		stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		std::vector<std::byte> data(std::filesystem::file_size(path));
+		stream.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		return data;
+	}
+
+	// Map versions differ in the payload, so the map is normalized to the latest version on saving
+	std::vector<std::string> compareMaps(const Map& original, const Map& reloaded) {
+		constexpr std::size_t maxObjectDifferences = 8;
+		std::vector<std::string> differences;
+
+		auto header = original.header;
+		header.mapVersion = reloaded.header.mapVersion;
+		if (header != reloaded.header)
+			differences.push_back("header");
+
+		if (original.objects.size() != reloaded.objects.size()) {
+			differences.push_back(std::format("objects count {} -> {}", original.objects.size(), reloaded.objects.size()));
+		} else {
+			std::size_t numDifferent = 0;
+			for (std::size_t i = 0; i < original.objects.size(); ++i) {
+				if (original.objects[i] != reloaded.objects[i] && numDifferent++ < maxObjectDifferences)
+					differences.push_back(std::format("object #{} (id {})", i, original.objects[i].id));
+			}
+			if (numDifferent > maxObjectDifferences)
+				differences.push_back(std::format("{} more objects", numDifferent - maxObjectDifferences));
+		}
+
+		if (original.armies != reloaded.armies)
+			differences.push_back("armies");
+
+		return differences;
+	}
+
+	std::string compareBytes(std::span<const std::byte> original, std::span<const std::byte> saved) {
+		const auto [originalIt, savedIt] = std::ranges::mismatch(original, saved);
+		if (originalIt == original.end() && savedIt == saved.end())
+			return {};
+
+		return std::format("from byte {}, size {} -> {}", originalIt - original.begin(), original.size(), saved.size());
+	}
+
+	ValidationResult validateMap(std::span<const Vid> vids, const std::filesystem::path& path, ValidationOutput output, const std::filesystem::path& outputPath) {
+		using Clock = std::chrono::steady_clock;
+		ValidationResult result {.map = path};
+		try {
+			const auto data = readFile(path);
+			result.fileSize = data.size();
+
+			auto begin = Clock::now();
+			const auto original = loadMap(vids, data);
+			result.loadTime = Clock::now() - begin;
+
+			begin = Clock::now();
+			const auto saved = serializeMap(vids, original);
+			result.saveTime = Clock::now() - begin;
+
+			begin = Clock::now();
+			const auto reloaded = loadMap(vids, saved);
+			result.reloadTime = Clock::now() - begin;
+
+			result.bytesDifference = compareBytes(data, saved);
+			result.differences = compareMaps(original, reloaded);
+
+			if (output == ValidationOutput::Map) {
+				std::ofstream file{outputPath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc};
+				file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+				file.write(reinterpret_cast<const char*>(saved.data()), static_cast<std::streamsize>(saved.size()));
+			} else if (output == ValidationOutput::Json) {
+				std::ofstream file{outputPath, std::ios_base::out | std::ios_base::trunc};
+				file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+				ExportMapToJson(vids, reloaded, file);
+			}
+		}
+		catch (const std::exception& e) {
+			result.error = e.what();
+		}
+
+		return result;
+	}
+
+	// "Monster=2.5" sets the density of monsters
+	std::pair<UnitType, float> parseDensity(std::string_view value) {
+		const auto separator = value.find('=');
+		const auto unitType = std::ranges::find(generatedUnitTypes, value.substr(0, separator), [](UnitType type) { return to_string(type); });
+		if (separator == std::string_view::npos || unitType == generatedUnitTypes.end())
+			throw std::invalid_argument(std::format("Invalid density \"{}\", should be like Monster=2.5", value));
+
+		return {*unitType, std::stof(std::string{value.substr(separator + 1)})};
+	}
+}
+
+std::optional<int> runBatchRender(const std::vector<std::string>& args) {
+	if (std::ranges::find(args, "--render-map") == args.end())
+		return std::nullopt;
+
+	argparse::ArgumentParser arguments{"Gromada viewer"};
+	addResourceArguments(arguments);
+	arguments.add_argument("--render-map")
+		.required()
+		.help("a .map file or a directory of them to render without opening the window");
+	arguments.add_argument("--out")
+		.required()
+		.help("a .png file, or a directory for the images if a directory of maps is rendered");
+	arguments.add_argument("--scale")
+		.default_value(1)
+		.scan<'i', int>()
+		.help("every N x N block of the map becomes a pixel of the image");
+
+	try {
+		arguments.parse_args(args);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << '\n' << arguments;
+		return 1;
+	}
+
+	try {
+		const auto resources = loadResources(arguments);
+
+		const auto jobs = collectJobs(arguments.get<std::string>("--render-map"), arguments.get<std::string>("--out"));
+		const int scale = arguments.get<int>("--scale");
+
+		// Every map is rendered by bands in parallel too, so the threads are busy even when maps are few
+		std::atomic<int> numFailed = 0;
+		ThreadPool::shared().parallelFor(jobs.size(), [&](std::size_t i) {
+			const auto& job = jobs[i];
+			try {
+				const auto image = renderMap(resources, loadMap(resources.vids(), job.map), scale);
+				savePng(job.image, image.width(), image.height(), std::as_bytes(image.pixels()));
+			}
+			catch (const std::exception& e) {
+				std::cerr << job.map.string() + ": " + e.what() + '\n';
+				++numFailed;
+			}
+		});
+
+		std::cout << std::format("Rendered {} of {} maps\n", jobs.size() - static_cast<std::size_t>(numFailed.load()), jobs.size());
+		return numFailed == 0 ? 0 : 1;
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
+
+std::optional<int> runBatchGenerate(const std::vector<std::string>& args) {
+	if (std::ranges::find(args, "--generate-map") == args.end())
+		return std::nullopt;
+
+	const MapGeneratorOptions defaults;
+	argparse::ArgumentParser arguments{"Gromada viewer"};
+	addResourceArguments(arguments);
+	arguments.add_argument("--generate-map")
+		.required()
+		.help("a .map file to write the generated map to, without opening the window");
+	arguments.add_argument("--seed")
+		.default_value(defaults.seed)
+		.scan<'u', std::uint32_t>();
+	arguments.add_argument("--width")
+		.default_value(defaults.width)
+		.scan<'i', int>();
+	arguments.add_argument("--height")
+		.default_value(defaults.height)
+		.scan<'i', int>();
+	arguments.add_argument("--no-terrain")
+		.default_value(false)
+		.implicit_value(true)
+		.help("don't cover the map with the base tiles");
+	arguments.add_argument("--density")
+		.append()
+		.help("objects of a unit type per 256x256 block, like Monster=2.5; the other types keep their default densities");
+
+	try {
+		arguments.parse_args(args);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << '\n' << arguments;
+		return 1;
+	}
+
+	try {
+		const auto resources = loadResources(arguments);
+
+		MapGeneratorOptions options {
+			.seed = arguments.get<std::uint32_t>("--seed"),
+			.width = arguments.get<int>("--width"),
+			.height = arguments.get<int>("--height"),
+			.terrain = !arguments.get<bool>("--no-terrain"),
+		};
+		for (const auto& density : arguments.present<std::vector<std::string>>("--density").value_or(std::vector<std::string>{})) {
+			const auto [unitType, value] = parseDensity(density);
+			options.densities.insert_or_assign(unitType, value);
+		}
+
+		const auto map = generateMap(resources, options);
+		const std::filesystem::path path {arguments.get<std::string>("--generate-map")};
+		saveMap(resources.vids(), map, path);
+
+		std::cout << std::format("Generated {} objects to {}\n", map.objects.size(), path.string());
+		return 0;
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
+
+std::optional<int> runBatchValidate(const std::vector<std::string>& args) {
+	if (std::ranges::find(args, "--validate-maps") == args.end())
+		return std::nullopt;
+
+	argparse::ArgumentParser arguments{"Gromada viewer"};
+	addResourceArguments(arguments);
+	arguments.add_argument("--validate-maps")
+		.required()
+		.help("a .map file or a directory of them to load, save and load again without opening the window");
+	arguments.add_argument("--out")
+		.help("a directory to write the saved maps to");
+	arguments.add_argument("--format")
+		.default_value(std::string{"map"})
+		.help("of the written maps: map (normalized to the latest version) or json");
+
+	try {
+		arguments.parse_args(args);
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << '\n' << arguments;
+		return 1;
+	}
+
+	try {
+		const auto resources = loadResources(arguments);
+
+		const auto format = arguments.get<std::string>("--format");
+		if (format != "map" && format != "json")
+			throw std::invalid_argument(std::format("Unknown format \"{}\", should be map or json", format));
+
+		const auto outputDirectory = arguments.present<std::string>("--out").transform([](const std::string& path) { return std::filesystem::path{path}; });
+		const auto output = !outputDirectory ? ValidationOutput::None : format == "json" ? ValidationOutput::Json : ValidationOutput::Map;
+		const auto jobs = collectValidationJobs(arguments.get<std::string>("--validate-maps"), outputDirectory, output);
+
+		// Every map is a job of its own, the directory is given in the most cases
+		const auto begin = std::chrono::steady_clock::now();
+		std::vector<ValidationResult> results(jobs.size());
+		ThreadPool::shared().parallelFor(jobs.size(), [&](std::size_t i) {
+			const auto& job = jobs[i];
+			results[i] = validateMap(resources.vids(), job.map, output, job.output);
+		});
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+
+		std::size_t numFailed = 0, numByteIdentical = 0, totalSize = 0;
+		for (const auto& result : results) {
+			totalSize += result.fileSize;
+			if (!result.error.empty()) {
+				++numFailed;
+				std::cout << std::format("FAIL {}: {}\n", result.map.string(), result.error);
+				continue;
+			}
+
+			numFailed += !result.differences.empty();
+			numByteIdentical += result.bytesDifference.empty();
+			std::cout << std::format("{} {}: load {:.2f} ms, save {:.2f} ms, reload {:.2f} ms, bytes {}\n",
+				result.differences.empty() ? "OK  " : "DIFF", result.map.string(), result.loadTime.count(), result.saveTime.count(), result.reloadTime.count(),
+				result.bytesDifference.empty() ? "identical" : "differ " + result.bytesDifference);
+			for (const auto& difference : result.differences)
+				std::cout << "    " << difference << '\n';
+		}
+
+		std::cout << std::format("{} of {} maps passed, {} byte-identical; {:.2f} s, {:.1f} maps/s, {:.1f} MB/s\n",
+			results.size() - numFailed, results.size(), numByteIdentical, elapsed.count(),
+			results.size() / elapsed.count(), totalSize / elapsed.count() / (1024.0 * 1024.0));
+		return numFailed == 0 ? 0 : 1;
+	}
+	catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
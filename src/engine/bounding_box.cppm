@@ -9,6 +9,8 @@ export struct BoundingBox {
 	int top;
 	int down;
 
+	constexpr bool operator==(const BoundingBox&) const noexcept = default;
+
 	[[nodiscard]] static constexpr BoundingBox fromPositions(int x1, int y1, int x2, int y2) noexcept { 
 		return {
 			.left = std::min(x1, x2),
@@ -0,0 +1,141 @@
+export module engine.damage_tracker;
+
+import std;
+import engine.bounding_box;
+
+// Identifies a sprite image id drawn at bounds, order of the combined hashes matters
+export std::uint64_t hashSprite(BoundingBox bounds, std::uint64_t id) noexcept;
+export std::uint64_t combineHashes(std::uint64_t seed, std::uint64_t hash) noexcept;
+
+// Finds the parts of the image that have to be redrawn since the previous frame.
+// The world is split into square tiles and every tile gets a hash of the sprites covering it, in the drawing order.
+// So any change of a sprite's image, position, presence or order makes dirty the tiles it covers now and the ones it covered before.
+export class DamageTracker {
+public:
+	static constexpr int tileSize = 32;
+
+	// Starts collecting sprites of a frame, area is the part of the world the image shows
+	void beginFrame(BoundingBox area);
+	// Sprites must be added in the drawing order, id must be unique for every sprite image
+	void addSprite(BoundingBox bounds, std::uint64_t id) noexcept;
+	// Returns the changed parts of the area as disjoint rectangles, after that the whole area is considered up to date
+	[[nodiscard]] std::vector<BoundingBox> endFrame();
+
+	// The next frame will be redrawn entirely
+	void invalidate() noexcept { m_hasPrevious = false; }
+
+private:
+	struct TileGrid {
+		BoundingBox area {};
+		BoundingBox tiles {}; // tiles overlapping the area, in tile units
+		std::vector<std::uint64_t> hashes;
+
+		[[nodiscard]] std::uint64_t& at(int tileX, int tileY) noexcept {
+			return hashes[static_cast<std::size_t>((tileY - tiles.top) * tiles.width() + tileX - tiles.left)];
+		}
+	};
+
+	[[nodiscard]] bool isTileDirty(int tileX, int tileY);
+
+private:
+	TileGrid m_current, m_previous;
+	bool m_hasPrevious = false;
+};
+
+
+// Implementation
+
+namespace {
+	constexpr int floorDiv(int value, int divisor) noexcept {
+		return value / divisor - (value % divisor != 0 && value < 0);
+	}
+
+	constexpr BoundingBox tilesOf(BoundingBox bounds) noexcept {
+		return {
+			.left = floorDiv(bounds.left, DamageTracker::tileSize),
+			.right = floorDiv(bounds.right - 1, DamageTracker::tileSize) + 1,
+			.top = floorDiv(bounds.top, DamageTracker::tileSize),
+			.down = floorDiv(bounds.down - 1, DamageTracker::tileSize) + 1,
+		};
+	}
+
+	// splitmix64 finalizer
+	constexpr std::uint64_t mix(std::uint64_t value) noexcept {
+		value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+		value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+		return value ^ (value >> 31);
+	}
+
+	constexpr std::uint64_t pack(int a, int b) noexcept {
+		return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(a)) << 32) | static_cast<std::uint32_t>(b);
+	}
+
+	constexpr bool contains(const BoundingBox& outer, const BoundingBox& inner) noexcept {
+		return inner.left >= outer.left && inner.right <= outer.right && inner.top >= outer.top && inner.down <= outer.down;
+	}
+}
+
+std::uint64_t hashSprite(BoundingBox bounds, std::uint64_t id) noexcept {
+	return mix(mix(id) ^ mix(pack(bounds.left, bounds.top)) ^ pack(bounds.width(), bounds.height()));
+}
+
+std::uint64_t combineHashes(std::uint64_t seed, std::uint64_t hash) noexcept {
+	return mix(seed + hash);
+}
+
+void DamageTracker::beginFrame(BoundingBox area) {
+	m_current.area = area;
+	m_current.tiles = area.empty() ? BoundingBox{} : tilesOf(area);
+	m_current.hashes.assign(static_cast<std::size_t>(m_current.tiles.width() * m_current.tiles.height()), 0);
+}
+
+void DamageTracker::addSprite(BoundingBox bounds, std::uint64_t id) noexcept {
+	const auto tiles = tilesOf(bounds).intersection(m_current.tiles);
+	if (bounds.empty() || tiles.empty())
+		return;
+
+	// Hash doesn't depend on the visible area, so a tile's hash stays the same while the camera moves
+	const auto spriteHash = hashSprite(bounds, id);
+	for (int tileY = tiles.top; tileY < tiles.down; ++tileY) {
+		for (int tileX = tiles.left; tileX < tiles.right; ++tileX) {
+			auto& hash = m_current.at(tileX, tileY);
+			hash = combineHashes(hash, spriteHash);
+		}
+	}
+}
+
+bool DamageTracker::isTileDirty(int tileX, int tileY) {
+	if (!m_hasPrevious)
+		return true;
+
+	// Only the part of the tile that was in the previous image could be reused
+	const auto visiblePart = BoundingBox::fromPositionAndSize(tileX * tileSize, tileY * tileSize, tileSize, tileSize).intersection(m_current.area);
+	if (!contains(m_previous.area, visiblePart))
+		return true;
+
+	return m_previous.at(tileX, tileY) != m_current.at(tileX, tileY);
+}
+
+std::vector<BoundingBox> DamageTracker::endFrame() {
+	std::vector<BoundingBox> dirtyRects;
+
+	// Dirty tiles of a row are merged into runs
+	const auto& tiles = m_current.tiles;
+	for (int tileY = tiles.top; tileY < tiles.down; ++tileY) {
+		std::optional<int> runBegin;
+		for (int tileX = tiles.left; tileX <= tiles.right; ++tileX) {
+			const bool dirty = tileX < tiles.right && isTileDirty(tileX, tileY);
+			if (dirty && !runBegin) {
+				runBegin = tileX;
+			} else if (!dirty && runBegin) {
+				dirtyRects.push_back(BoundingBox{*runBegin * tileSize, tileX * tileSize, tileY * tileSize, (tileY + 1) * tileSize}.intersection(m_current.area));
+				runBegin.reset();
+			}
+		}
+	}
+
+	std::swap(m_current, m_previous);
+	m_hasPrevious = true;
+
+	return dirtyRects;
+}
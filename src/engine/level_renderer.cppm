@@ -9,13 +9,17 @@ import std;
 import framebuffer;
 
 import engine.bounding_box;
+import engine.damage_tracker;
 import engine.objects_view;
+import engine.terrain_layer;
 import engine.world_components;
 
 import Gromada.Resources;
 import Gromada.SoftwareRenderer;
 import Gromada.VisualLogic;
 
+import profiler;
+import thread_pool;
 import utils;
 
 export struct Viewport {
@@ -37,42 +41,230 @@ export struct Viewport {
     }
 };
 
+export struct RenderSettings {
+    // Only the parts of the framebuffer which have changed since the previous frame are redrawn, otherwise everything is redrawn every frame
+    bool incremental = true;
+    // Dirty parts of the framebuffer are drawn in parallel
+    bool parallel = true;
+    // Terrain is drawn from the pre-composited chunks (see TerrainLayer) before all the other sprites
+    bool cacheTerrain = true;
+};
+
 export class LevelRenderer {
 public:
 	LevelRenderer(const flecs::world& world) {
-	    struct RenderOrder {
-	        auto operator <=>(const RenderOrder&) const = default;
-	        RenderOrder() = default;
-	        RenderOrder(const Transform& transform, const Vid& vid) : m_tuple{vid.z_layer, transform.y + vid.graphics().height / 10 + transform.z} {}
-
-	    private:
-	        std::tuple<unsigned char, int> m_tuple;
-	    };
-	    world.component<RenderOrder>();
-	    world.system<const Transform, const VidRef>()
-	        .term_at(0).second<World>()
-            .kind(flecs::OnUpdate)
-	        .write<RenderOrder>()
-            .each([](flecs::entity entity, const Transform& world_transform, const Vid& vid) {
-                entity.ensure<RenderOrder>() = {world_transform, vid};
-        });
-
 	    world.component<Viewport>().add(flecs::Singleton);
 	    world.set<Viewport>({.viewportSize = {1024, 768}});
 
 	    world.component<Framebuffer>().add(flecs::Singleton);
 	    world.set<Framebuffer>({1024, 768});
 
-	    // const auto time = std::chrono::high_resolution_clock::now();
-	    // const auto renderDuration = std::chrono::high_resolution_clock::now() - time;
-	    world.system<Framebuffer, const Viewport, const Transform, const VidRef, const AnimationComponent>()
-            .term_at(2).second<World>()
+	    world.component<RenderSettings>().add(flecs::Singleton);
+	    world.set<RenderSettings>({});
+
+	    // Sprites are collected in the drawing order first, then every dirty rectangle of the framebuffer is cleared and draws all of them clipped to itself.
+	    // Each pixel gets the same sequence of writes as in the sequential drawing, so the result is identical
+	    struct DrawCommand {
+	        const VidGraphics::Frame* frame;
+	        glm::ivec2 pos; // in the world coordinates
+	    };
+	    struct RenderQueue {
+	        std::vector<DrawCommand> commands;
+	        std::vector<DrawCommand> terrain; // only if it's cached
+	        TerrainLayer terrainLayer;
+	        DamageTracker damage;
+	        std::optional<BoundingBox> framebufferArea; // part of the world the framebuffer shows now
+	    };
+	    world.component<RenderQueue>().add(flecs::Singleton);
+	    world.set<RenderQueue>({});
+
+	    // Drawing order is kept in a persistent list sorted by packed keys, only the objects whose key has changed are re-sorted
+	    struct RenderItem {
+	        std::uint64_t key = 0;
+	        flecs::entity_t entity = 0;
+	        glm::ivec2 pos {}; // of the sprite's top-left corner in the world
+	        const Vid* vid = nullptr;
+
+	        // z_layer, then depth (biased to be unsigned), then low bits of the entity id to make the order stable
+	        RenderItem(flecs::entity_t entity, const Transform& transform, const Vid& vid)
+	            : key{std::uint64_t{vid.z_layer} << 56 |
+	                  std::uint64_t{static_cast<std::uint32_t>(getDrawingDepth(vid, transform.y, transform.z)) ^ 0x80000000u} << 24 |
+	                  (entity & 0xFFFFFF)}
+	            , entity{entity}
+	            , pos{transform.x - vid.graphicsHeader().width / 2, transform.y - vid.graphicsHeader().height / 2 - transform.z}
+	            , vid{&vid} {}
+	        RenderItem() = default;
+
+	        bool operator==(const RenderItem&) const = default;
+	        [[nodiscard]] auto order() const noexcept { return std::tie(key, entity); }
+	    };
+	    // The item an entity is in the render list with
+	    struct RenderListEntry {
+	        std::optional<RenderItem> item;
+	    };
+	    struct RenderList {
+	        std::vector<RenderItem> items; // sorted by order()
+	        std::vector<RenderItem> inserted, removed;
+
+	        void insert(const RenderItem& item) { inserted.push_back(item); }
+	        void remove(const RenderItem& item) {
+	            // It could be not in the list yet
+	            if (const auto it = std::ranges::find(inserted, item); it != inserted.end()) {
+	                inserted.erase(it);
+	            } else {
+	                removed.push_back(item);
+	            }
+	        }
+
+	        // Costs a sort of the changed items and a linear pass over the list
+	        void applyChanges() {
+	            const auto byOrder = [](const RenderItem& a, const RenderItem& b) { return a.order() < b.order(); };
+	            if (!removed.empty()) {
+	                std::ranges::sort(removed, byOrder);
+	                std::erase_if(items, [&](const RenderItem& item) { return std::ranges::binary_search(removed, item, byOrder); });
+	                removed.clear();
+	            }
+
+	            if (!inserted.empty()) {
+	                std::ranges::sort(inserted, byOrder);
+	                const auto middle = static_cast<std::ptrdiff_t>(items.size());
+	                items.insert(items.end(), inserted.begin(), inserted.end());
+	                std::ranges::inplace_merge(items, items.begin() + middle, byOrder);
+	                inserted.clear();
+	            }
+	        }
+	    };
+	    world.component<RenderListEntry>();
+	    world.component<RenderList>().add(flecs::Singleton);
+	    world.set<RenderList>({});
+
+	    world.observer<const VidRef>()
+	        .event(flecs::OnSet)
+	        .each([](flecs::entity entity, const VidRef&) { entity.add<RenderListEntry>(); });
+	    world.observer<const VidRef>()
+	        .event(flecs::OnRemove)
+	        .each([](flecs::entity entity, const VidRef&) { entity.remove<RenderListEntry>(); });
+	    world.observer<const RenderListEntry>()
+	        .event(flecs::OnRemove)
+	        .each([](flecs::entity entity, const RenderListEntry& entry) {
+	            // Render list could already be gone while the world is destroyed
+	            auto* list = entity.world().try_get_mut<RenderList>();
+	            if (list && entry.item)
+	                list->remove(*entry.item);
+	        });
+
+	    world.system<RenderList, RenderListEntry, const Transform, const VidRef>()
+	        .term_at(2).second<World>()
+	        .kind(flecs::PostUpdate)
+	        .run(profiledRun("Render list update"))
+	        .each([](flecs::entity entity, RenderList& list, RenderListEntry& entry, const Transform& transform, const Vid& vid) {
+	            const RenderItem item {entity, transform, vid};
+	            if (entry.item == item)
+	                return;
+
+	            if (entry.item)
+	                list.remove(*entry.item);
+	            list.insert(item);
+	            entry.item = item;
+	        });
+
+	    world.system<RenderList, RenderQueue, const Viewport, const RenderSettings>()
+            .kind(flecs::PreStore)
+            .run(profiledRun("Render list collect"))
+            .each([](flecs::iter& it, std::size_t, RenderList& list, RenderQueue& queue, const Viewport& viewport, const RenderSettings& settings) {
+                list.applyChanges();
+
+                // Terrain chunks partially visible on the screen need all of their sprites
+                const auto viewportArea = viewport.bounds();
+                const auto terrainArea = TerrainLayer::coveredArea(viewportArea);
+                for (const auto& item : list.items) {
+                    const auto& vid = *item.vid;
+                    const auto& header = vid.graphicsHeader();
+                    const bool isCachedTerrain = settings.cacheTerrain && vid.unitType == UnitType::Terrain;
+                    // Don't force decoding of sprites that are entirely off-screen
+                    if (!(isCachedTerrain ? terrainArea : viewportArea).isIntersects(BoundingBox::fromPositionAndSize(item.pos.x, item.pos.y, header.width, header.height)))
+                        continue;
+
+                    const auto* animation = flecs::entity{it.world().c_ptr(), item.entity}.try_get<AnimationComponent>();
+                    if (!animation)
+                        continue;
+
+                    const auto& graphics = vid.graphics();
+                    assert(animation->current_frame < graphics.frames.size());
+                    (isCachedTerrain ? queue.terrain : queue.commands).push_back({&graphics.frames[animation->current_frame], item.pos});
+                }
+        });
+
+	    world.system<Framebuffer, RenderQueue, const Viewport, const RenderSettings>()
             .kind(flecs::PreStore)
-            .with<const RenderOrder>().order_by<const RenderOrder>([](flecs::entity_t, const RenderOrder* a, flecs::entity_t, const RenderOrder* b) -> int { return ordering_to_int(*a <=> *b);})
-            .each([](Framebuffer& framebuffer, const Viewport& viewport, const Transform& transform, const Vid& vid, const AnimationComponent& animation) {
-            	assert(animation.current_frame < vid.graphics().frames.size());
-                const glm::ivec2 pos = glm::ivec2{transform.x - vid.graphics().width / 2, transform.y - vid.graphics().height / 2 - transform.z} - viewport.viewportPos;
-                DrawSprite(vid.graphics().frames[animation.current_frame], pos.x, pos.y, framebuffer);
+            .run(profiledRun("Level draw"))
+            .each([](Framebuffer& framebuffer, RenderQueue& queue, const Viewport& viewport, const RenderSettings& settings) {
+                const FramebufferRef target = framebuffer;
+                if (target.extent(0) == 0 || target.extent(1) == 0) {
+                    queue.commands.clear();
+                    queue.terrain.clear();
+                    return;
+                }
+
+                const auto forEachIndex = [&](std::size_t count, const auto& fn) {
+                    if (settings.parallel) {
+                        ThreadPool::shared().parallelFor(count, fn);
+                    } else {
+                        for (std::size_t i = 0; i < count; ++i)
+                            fn(i);
+                    }
+                };
+
+                const auto area = BoundingBox::fromPositionAndSize(viewport.viewportPos.x, viewport.viewportPos.y, target.extent(1), target.extent(0));
+                const auto& previousArea = queue.framebufferArea;
+                if (!settings.incremental || !previousArea || previousArea->width() != area.width() || previousArea->height() != area.height()) {
+                    queue.damage.invalidate();
+                } else if (previousArea->left != area.left || previousArea->top != area.top) {
+                    // Camera has moved: the image is scrolled to keep the world in place, and the uncovered parts turn out dirty
+                    framebuffer.scroll({previousArea->left - area.left, previousArea->top - area.top});
+                }
+                queue.framebufferArea = area;
+
+                if (settings.cacheTerrain) {
+                    const ProfileScope scope{"Terrain chunks rebuild"};
+                    queue.terrainLayer.beginFrame(area);
+                    for (const auto& command : queue.terrain)
+                        queue.terrainLayer.addSprite(*command.frame, command.pos);
+
+                    forEachIndex(queue.terrainLayer.endFrame(), [&](std::size_t i) { queue.terrainLayer.rebuildChunk(i); });
+                }
+
+                // Terrain goes first, as it's drawn
+                queue.damage.beginFrame(area);
+                for (const auto* commands : {&queue.terrain, &queue.commands}) {
+                    for (const auto& command : *commands) {
+                        const auto& graphics = *command.frame->parent;
+                        queue.damage.addSprite(BoundingBox::fromPositionAndSize(command.pos.x, command.pos.y, graphics.width, graphics.height), reinterpret_cast<std::uintptr_t>(command.frame));
+                    }
+                }
+
+                // Rectangles are disjoint, full redraw gives a band per row of tiles
+                const auto dirtyRects = queue.damage.endFrame();
+                const ProfileScope drawScope{"Dirty rects draw"};
+                forEachIndex(dirtyRects.size(), [&](std::size_t i) {
+                    const auto& rect = dirtyRects[i];
+                    const auto clipRect = rect.getTranslated(-area.left, -area.top);
+                    if (settings.cacheTerrain) {
+                        queue.terrainLayer.draw(target, {area.left, area.top}, rect);
+                    } else {
+                        for (int y = clipRect.top; y < clipRect.down; ++y)
+                            std::ranges::fill_n(&target[y, clipRect.left], clipRect.width(), RGBA8{0, 0, 0, 0});
+                    }
+
+                    for (const auto& command : queue.commands)
+                        DrawSprite(*command.frame, command.pos.x - area.left, command.pos.y - area.top, target, clipRect);
+                });
+
+                if (!dirtyRects.empty())
+                    framebuffer.markDirty();
+
+                queue.commands.clear();
+                queue.terrain.clear();
         });
 	}
 };
\ No newline at end of file
@@ -33,7 +33,7 @@ struct Transform {
 
 struct VisualBoundsFn {
 	BoundingBox operator()(const Vid& vid, const Transform& obj) const {
-		return getCenteredBB({obj.x, obj.y}, {vid.graphics().width, vid.graphics().height});
+		return getCenteredBB({obj.x, obj.y}, {vid.graphicsHeader().width, vid.graphicsHeader().height});
 	}
 };
 struct PhysicalBoundsFn {
@@ -42,6 +42,67 @@ struct PhysicalBoundsFn {
 	}
 };
 
+// Bounds the entity is currently indexed with by ObjectsView, empty ones aren't indexed
+struct SpatialIndexEntry {
+	BoundingBox visual {};
+	BoundingBox physical {};
+};
+
+}
+
+// Uniform grid of the world, every cell lists the entities which bounds overlap it
+class SpatialGrid {
+public:
+	static constexpr int cellSize = 128;
+
+	void insert(flecs::entity_t entity, BoundingBox bounds);
+	void erase(flecs::entity_t entity, BoundingBox bounds);
+
+	// Calls callback(entity) once for every entity intersecting the region
+	void query(BoundingBox region, const auto& callback) const {
+		const auto cells = cellsOf(region);
+		for (int cellY = cells.top; cellY < cells.down; ++cellY) {
+			for (int cellX = cells.left; cellX < cells.right; ++cellX) {
+				const auto it = m_cells.find(cellKey(cellX, cellY));
+				if (it == m_cells.end())
+					continue;
+
+				for (const auto& item : it->second) {
+					// Entity could be in several cells, it's reported from the one with the top-left corner of the overlap
+					const auto overlap = item.bounds.intersection(region);
+					if (!overlap.empty() && cellOf(overlap.left) == cellX && cellOf(overlap.top) == cellY)
+						callback(item.entity);
+				}
+			}
+		}
+	}
+
+private:
+	struct Item {
+		flecs::entity_t entity;
+		BoundingBox bounds;
+	};
+
+	static constexpr int cellOf(int coordinate) noexcept {
+		return coordinate / cellSize - (coordinate % cellSize != 0 && coordinate < 0);
+	}
+	static constexpr BoundingBox cellsOf(BoundingBox bounds) noexcept {
+		if (bounds.empty())
+			return {};
+
+		return {cellOf(bounds.left), cellOf(bounds.right - 1) + 1, cellOf(bounds.top), cellOf(bounds.down - 1) + 1};
+	}
+	static constexpr std::uint64_t cellKey(int cellX, int cellY) noexcept {
+		return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(cellX)) << 32) | static_cast<std::uint32_t>(cellY);
+	}
+
+private:
+	std::unordered_map<std::uint64_t, std::vector<Item>> m_cells;
+};
+
+export {
+
+// Finds objects by their bounds in the world, with an index maintained by WorldModule
 class ObjectsView {
 public:
 	struct VisualBounds {};
@@ -49,27 +110,79 @@ public:
 	constexpr static inline VisualBounds visualBounds{};
 	constexpr static inline PhysicalBounds physicalBounds{};
 
-	ObjectsView(flecs::world& world) { m_query = world.query_builder<const VidRef, const Transform>().term_at(1).second<World>().cached().build(); }
+	ObjectsView(flecs::world& world) : m_world{world.c_ptr()} {}
 
     inline void queryObjectsInRegion([[maybe_unused]] VisualBounds, BoundingBox region, const auto& callback) const {
-	    queryObjectsInRegionImpl(VisualBoundsFn{}, region, callback);
+	    queryObjectsInRegionImpl(m_visualGrid, region, callback);
 	}
 
 	 inline void queryObjectsInRegion([[maybe_unused]] PhysicalBounds, BoundingBox region, const auto& callback) const {
-	    queryObjectsInRegionImpl(PhysicalBoundsFn{}, region, callback);
+	    queryObjectsInRegionImpl(m_physicalGrid, region, callback);
 	 }
+
+	// Moves the entity in the index if its bounds have changed
+	void update(flecs::entity_t entity, SpatialIndexEntry& entry, const Vid& vid, const Transform& transform);
+	void remove(flecs::entity_t entity, SpatialIndexEntry& entry);
+
 private:
-    void queryObjectsInRegionImpl(auto&& boundsFn, BoundingBox region, const auto& callback) const {
-        m_query.each([region, boundsFn, &callback](flecs::entity entity, const Vid& vid, const Transform& obj) {
-            if (boundsFn(vid, obj).isIntersects(region)) {
-                std::invoke(callback,entity/*, vid, obj*/);
-            }
+    void queryObjectsInRegionImpl(const SpatialGrid& grid, BoundingBox region, const auto& callback) const {
+        grid.query(region, [this, &callback](flecs::entity_t entity) {
+            std::invoke(callback, flecs::entity{m_world, entity});
         });
-
     }
 
 private:
-	flecs::query<const VidRef, const Transform> m_query;
+	flecs::world_t* m_world;
+	SpatialGrid m_visualGrid, m_physicalGrid;
 };
 
 }
+
+
+// Implementation
+
+void SpatialGrid::insert(flecs::entity_t entity, BoundingBox bounds) {
+	const auto cells = cellsOf(bounds);
+	for (int cellY = cells.top; cellY < cells.down; ++cellY) {
+		for (int cellX = cells.left; cellX < cells.right; ++cellX)
+			m_cells[cellKey(cellX, cellY)].push_back({entity, bounds});
+	}
+}
+
+void SpatialGrid::erase(flecs::entity_t entity, BoundingBox bounds) {
+	const auto cells = cellsOf(bounds);
+	for (int cellY = cells.top; cellY < cells.down; ++cellY) {
+		for (int cellX = cells.left; cellX < cells.right; ++cellX) {
+			const auto it = m_cells.find(cellKey(cellX, cellY));
+			if (it == m_cells.end())
+				continue;
+
+			auto& items = it->second;
+			if (const auto item = std::ranges::find(items, entity, &Item::entity); item != items.end()) {
+				*item = items.back();
+				items.pop_back();
+			}
+			if (items.empty())
+				m_cells.erase(it);
+		}
+	}
+}
+
+void ObjectsView::update(flecs::entity_t entity, SpatialIndexEntry& entry, const Vid& vid, const Transform& transform) {
+	const auto updateGrid = [entity](SpatialGrid& grid, BoundingBox& indexedBounds, BoundingBox bounds) {
+		if (bounds == indexedBounds)
+			return;
+
+		grid.erase(entity, indexedBounds);
+		grid.insert(entity, bounds);
+		indexedBounds = bounds;
+	};
+
+	updateGrid(m_visualGrid, entry.visual, VisualBoundsFn{}(vid, transform));
+	updateGrid(m_physicalGrid, entry.physical, PhysicalBoundsFn{}(vid, transform));
+}
+
+void ObjectsView::remove(flecs::entity_t entity, SpatialIndexEntry& entry) {
+	m_visualGrid.erase(entity, std::exchange(entry.visual, {}));
+	m_physicalGrid.erase(entity, std::exchange(entry.physical, {}));
+}
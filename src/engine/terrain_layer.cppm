@@ -0,0 +1,176 @@
+module;
+#include <cassert>
+#include <glm/glm.hpp>
+
+export module engine.terrain_layer;
+
+import std;
+
+import engine.bounding_box;
+import engine.damage_tracker;
+
+import Gromada.Resources;
+import Gromada.SoftwareRenderer;
+
+// Pre-composited terrain, split into square chunks of the world.
+// Terrain sprites are given every frame, but a chunk is only redrawn when the sprites covering it have changed:
+// so the terrain costs a copy per visible chunk, instead of decoding all of its sprites.
+// Chunks far from the visible area are dropped.
+export class TerrainLayer {
+public:
+	static constexpr int chunkSize = 256;
+
+	// Part of the world covered by the chunks visible in area, terrain sprites intersecting it must be added
+	[[nodiscard]] static BoundingBox coveredArea(BoundingBox area) noexcept;
+
+	void beginFrame(BoundingBox area);
+	// Sprites must be added in the drawing order
+	void addSprite(const VidGraphics::Frame& frame, glm::ivec2 pos);
+	// Returns the number of chunks which have to be rebuilt before drawing
+	[[nodiscard]] std::size_t endFrame();
+	// Rebuilds one of the chunks found by endFrame, different chunks could be rebuilt in parallel
+	void rebuildChunk(std::size_t index);
+
+	// Copies rect of the world (inside the area) to the target, which top-left corner is at origin of the world.
+	// Pixels not covered by the terrain are transparent black, so it replaces clearing of the target
+	void draw(FramebufferRef target, glm::ivec2 origin, BoundingBox rect) const;
+
+private:
+	struct Sprite {
+		const VidGraphics::Frame* frame;
+		glm::ivec2 pos;
+	};
+
+	struct Chunk {
+		glm::ivec2 origin;
+		std::vector<Sprite> sprites;
+		std::uint64_t hash = 0;
+		std::optional<std::uint64_t> builtHash;
+		std::vector<RGBA8> pixels; // empty if there is no terrain in the chunk
+	};
+
+	[[nodiscard]] const Chunk* findChunk(int chunkX, int chunkY) const;
+
+private:
+	std::unordered_map<std::uint64_t, Chunk> m_chunks;
+	BoundingBox m_visibleChunks {}; // in chunk units
+	std::vector<Chunk*> m_staleChunks;
+};
+
+
+// Implementation
+
+namespace {
+	constexpr int floorDiv(int value, int divisor) noexcept {
+		return value / divisor - (value % divisor != 0 && value < 0);
+	}
+
+	constexpr BoundingBox chunksOf(BoundingBox bounds) noexcept {
+		if (bounds.empty())
+			return {};
+
+		return {
+			.left = floorDiv(bounds.left, TerrainLayer::chunkSize),
+			.right = floorDiv(bounds.right - 1, TerrainLayer::chunkSize) + 1,
+			.top = floorDiv(bounds.top, TerrainLayer::chunkSize),
+			.down = floorDiv(bounds.down - 1, TerrainLayer::chunkSize) + 1,
+		};
+	}
+
+	constexpr std::uint64_t chunkKey(int chunkX, int chunkY) noexcept {
+		return (static_cast<std::uint64_t>(static_cast<std::uint32_t>(chunkX)) << 32) | static_cast<std::uint32_t>(chunkY);
+	}
+}
+
+BoundingBox TerrainLayer::coveredArea(BoundingBox area) noexcept {
+	const auto chunks = chunksOf(area);
+	return {chunks.left * chunkSize, chunks.right * chunkSize, chunks.top * chunkSize, chunks.down * chunkSize};
+}
+
+void TerrainLayer::beginFrame(BoundingBox area) {
+	m_visibleChunks = chunksOf(area);
+	m_staleChunks.clear();
+
+	// A margin of one chunk is kept, so moving the camera back and forth doesn't rebuild them
+	const auto keptChunks = BoundingBox{m_visibleChunks.left - 1, m_visibleChunks.right + 1, m_visibleChunks.top - 1, m_visibleChunks.down + 1};
+	std::erase_if(m_chunks, [&](const auto& item) {
+		const auto chunkPos = item.second.origin / chunkSize;
+		return chunkPos.x < keptChunks.left || chunkPos.x >= keptChunks.right || chunkPos.y < keptChunks.top || chunkPos.y >= keptChunks.down;
+	});
+
+	for (int chunkY = m_visibleChunks.top; chunkY < m_visibleChunks.down; ++chunkY) {
+		for (int chunkX = m_visibleChunks.left; chunkX < m_visibleChunks.right; ++chunkX) {
+			auto& chunk = m_chunks[chunkKey(chunkX, chunkY)];
+			chunk.origin = {chunkX * chunkSize, chunkY * chunkSize};
+			chunk.sprites.clear();
+			chunk.hash = 0;
+		}
+	}
+}
+
+void TerrainLayer::addSprite(const VidGraphics::Frame& frame, glm::ivec2 pos) {
+	const auto bounds = BoundingBox::fromPositionAndSize(pos.x, pos.y, frame.width(), frame.height());
+	const auto chunks = chunksOf(bounds).intersection(m_visibleChunks);
+	if (chunks.empty())
+		return;
+
+	const auto spriteHash = hashSprite(bounds, reinterpret_cast<std::uintptr_t>(&frame));
+	for (int chunkY = chunks.top; chunkY < chunks.down; ++chunkY) {
+		for (int chunkX = chunks.left; chunkX < chunks.right; ++chunkX) {
+			auto& chunk = m_chunks[chunkKey(chunkX, chunkY)];
+			chunk.sprites.push_back({&frame, pos});
+			chunk.hash = combineHashes(chunk.hash, spriteHash);
+		}
+	}
+}
+
+std::size_t TerrainLayer::endFrame() {
+	for (int chunkY = m_visibleChunks.top; chunkY < m_visibleChunks.down; ++chunkY) {
+		for (int chunkX = m_visibleChunks.left; chunkX < m_visibleChunks.right; ++chunkX) {
+			auto& chunk = m_chunks[chunkKey(chunkX, chunkY)];
+			if (chunk.builtHash != chunk.hash)
+				m_staleChunks.push_back(&chunk);
+		}
+	}
+
+	return m_staleChunks.size();
+}
+
+void TerrainLayer::rebuildChunk(std::size_t index) {
+	auto& chunk = *m_staleChunks[index];
+	chunk.builtHash = chunk.hash;
+	if (chunk.sprites.empty()) {
+		chunk.pixels = {};
+		return;
+	}
+
+	chunk.pixels.assign(chunkSize * chunkSize, RGBA8{0, 0, 0, 0});
+	const FramebufferRef target {chunk.pixels.data(), std::dextents<int, 2>{chunkSize, chunkSize}};
+	for (const auto& sprite : chunk.sprites)
+		DrawSprite(*sprite.frame, sprite.pos.x - chunk.origin.x, sprite.pos.y - chunk.origin.y, target);
+}
+
+const TerrainLayer::Chunk* TerrainLayer::findChunk(int chunkX, int chunkY) const {
+	const auto it = m_chunks.find(chunkKey(chunkX, chunkY));
+	return it != m_chunks.end() ? &it->second : nullptr;
+}
+
+void TerrainLayer::draw(FramebufferRef target, glm::ivec2 origin, BoundingBox rect) const {
+	const auto chunks = chunksOf(rect);
+	for (int chunkY = chunks.top; chunkY < chunks.down; ++chunkY) {
+		for (int chunkX = chunks.left; chunkX < chunks.right; ++chunkX) {
+			const auto* chunk = findChunk(chunkX, chunkY);
+			assert(chunk && chunk->builtHash == chunk->hash);
+
+			const auto part = BoundingBox::fromPositionAndSize(chunk->origin.x, chunk->origin.y, chunkSize, chunkSize).intersection(rect);
+			for (int y = part.top; y < part.down; ++y) {
+				RGBA8* destination = &target[y - origin.y, part.left - origin.x];
+				if (chunk->pixels.empty()) {
+					std::fill_n(destination, part.width(), RGBA8{0, 0, 0, 0});
+				} else {
+					std::copy_n(&chunk->pixels[(y - chunk->origin.y) * chunkSize + part.left - chunk->origin.x], part.width(), destination);
+				}
+			}
+		}
+	}
+}
@@ -7,6 +7,7 @@ import std;
 export import Gromada.GameResources;
 import Gromada.Map;
 import Gromada.VisualLogic;
+import profiler;
 export import engine.objects_view;
 
 export {
@@ -18,13 +19,36 @@ export {
         std::uint32_t current_frame = 0;
     };
 
+    // Objects of the same vid don't play their animations in sync
+    std::uint32_t initialAnimationFrame(flecs::entity_t entity) {
+        return static_cast<std::uint32_t>(std::hash<std::uint64_t>{}(entity));
+    }
+
+    // Some vids have another object attached (e.g. a turret), it's created as a child of the entity
+    void spawnLinkedObject(flecs::entity entity, const VidRef& vid) {
+        if (vid->linkedObjectVid <= 0)
+            return;
+
+        entity.world()
+            .entity()
+            .set<Transform, Local>({
+                .x = vid->linkX,
+                .y = vid->linkY,
+                .z = vid->linkZ,
+                .direction = 0,
+            })
+            .emplace<VidRef>(vid.parent().getVid(vid->linkedObjectVid))
+            .child_of(entity);
+    }
+
     class WorldModule {
     public:
         WorldModule(flecs::world& world) {
             world.component<GameObject::Payload>();
             world.component<VidRef>();
             world.component<MapHeaderRawData>();
-            world.component<ObjectsView>();
+            world.component<ObjectsView>().add(flecs::Singleton);
+            world.component<SpatialIndexEntry>();
             world.component<GameResources>();
             world.component<DestroyAfterUpdate>();
             world.component<AnimationComponent>();
@@ -41,33 +65,36 @@ export {
             world.observer<const VidRef>()
                 .event(flecs::OnSet)
                 .each([](flecs::entity entity, const VidRef& vid) {
-                if (vid->linkedObjectVid > 0) {
-                    entity.world()
-                        .entity()
-                        .set<Transform, Local>({
-                            .x = vid->linkX,
-                            .y = vid->linkY,
-                            .z = vid->linkZ,
-                            .direction = 0,
-                        })
-                        .emplace<VidRef>(vid.parent().getVid(vid->linkedObjectVid))
-                        .child_of(entity);
-                }
+                spawnLinkedObject(entity, vid);
 
                 entity.emplace<AnimationComponent>(AnimationComponent{
-                    .current_frame = static_cast<std::uint32_t>(std::hash<std::uint64_t>{}(entity.id()))
+                    .current_frame = initialAnimationFrame(entity)
                 });
                 entity.add<Transform, World>();
+                entity.add<SpatialIndexEntry>();
             });
 
+            world.observer<const VidRef>()
+                .event(flecs::OnRemove)
+                .each([](flecs::entity entity, const VidRef&) { entity.remove<SpatialIndexEntry>(); });
+
+            world.observer<SpatialIndexEntry>()
+                .event(flecs::OnRemove)
+                .each([](flecs::entity entity, SpatialIndexEntry& entry) {
+                    // Objects view could already be gone while the world is destroyed
+                    if (auto* objectsView = entity.world().try_get_mut<ObjectsView>())
+                        objectsView->remove(entity, entry);
+                });
 
-            world.system<DestroyAfterUpdate>().kind(flecs::PostFrame).each([](flecs::entity entity, DestroyAfterUpdate) { entity.destruct(); });
+
+            world.system<DestroyAfterUpdate>().kind(flecs::PostFrame).run(profiledRun("DestroyAfterUpdate")).each([](flecs::entity entity, DestroyAfterUpdate) { entity.destruct(); });
 
             world.system<AnimationComponent, const VidRef, const Transform>()
                 .kind(flecs::OnUpdate)
                 .term_at(2).second<World>()
+                .run(profiledRun("Animation"))
                 .each([](flecs::iter& it, size_t, AnimationComponent& animation, const Vid& vid, const Transform& wt) {
-                    animation.current_frame += animation.stopwatch.advance(it.delta_time(), vid.graphics().frameDuration * 0.001f);
+                    animation.current_frame += animation.stopwatch.advance(it.delta_time(), vid.graphicsHeader().frameDuration * 0.001f);
 
                     const auto frame_range = getAnimationFrameRange(vid, animation.action, wt.direction);
                     if (frame_range) {
@@ -76,14 +103,19 @@ export {
                         animation.current_frame = 0;
                     }
 
-                    assert(animation.current_frame <= vid.graphics().numOfFrames);
+                    assert(animation.current_frame <= vid.graphicsHeader().numOfFrames);
                 });
 
+            // Only the tables whose local transforms, entities or parents' world transforms have changed are visited. World transforms are
+            // written only (out), so the system doesn't trigger itself; parents go first (cascade), so their changes reach the children in the same run
             world.system<const Transform, const Transform*, Transform>()
                 .term_at(0).second<Local>()
                 .term_at(1).second<World>() //.parent().cascade()
-                .term_at(2).second<World>()
+                .term_at(2).second<World>().out()
                 .term_at(1).parent().cascade()
+                .cached()
+                .detect_changes()
+                .run(changedTablesRun("Transform propagation"))
                 .each([](const Transform& local, const Transform* parent_world, Transform& out_world) {
                     out_world = local;
                     if (parent_world) {
@@ -93,6 +125,19 @@ export {
                         out_world.direction += parent_world->direction;
                     }
                 });
+
+            // Most of the objects don't move, so only the tables with changed world transforms or vids (or new entities) are visited.
+            // Entries are the index's own bookkeeping, written only (out) so they don't trigger the system; the view is taken aside for the same reason
+            world.system<SpatialIndexEntry, const VidRef, const Transform>()
+                .term_at(0).out()
+                .term_at(2).second<World>()
+                .kind(flecs::PostUpdate)
+                .cached()
+                .detect_changes()
+                .run(changedTablesRun("Spatial index update"))
+                .each([](flecs::entity entity, SpatialIndexEntry& entry, const Vid& vid, const Transform& transform) {
+                    entity.world().get_mut<ObjectsView>().update(entity, entry, vid, transform);
+                });
         }
     };
 }
\ No newline at end of file
@@ -24,28 +24,62 @@ public:
 			  .height = height,
 			  .pixel_format = SG_PIXELFORMAT_RGBA8,
 		  }, {}, {}},
-		  m_data{static_cast<size_t>(width * height), RGBA8{0, 0, 0, 0}},
-		  m_dataDesc{m_data.data(), std::dextents<int, 2>{height, width}} {}
+		  m_pixels{width, height} {}
 
 	void resize(glm::ivec2 newSize) {
-		if (m_dataDesc.extent(0) == newSize.y || m_dataDesc.extent(1) == newSize.x || newSize.x <= 0 || newSize.y <= 0)
+		if ((m_pixels.height() == newSize.y && m_pixels.width() == newSize.x) || newSize.x <= 0 || newSize.y <= 0)
 			return;
 
 		Framebuffer copy{newSize.x, newSize.y};
 		std::swap(*this, copy);
 	}
 
-	void clear(RGBA8 color) { std::ranges::fill(m_data, color); }
+	void clear(RGBA8 color) {
+		std::ranges::fill(m_pixels.pixels(), color);
+		m_dirty = true;
+	}
+
+	// Moves the image by offset pixels, the uncovered area keeps stale pixels and has to be redrawn
+	void scroll(glm::ivec2 offset) {
+		const FramebufferRef image = m_pixels;
+		const int width = image.extent(1), height = image.extent(0);
+		if (offset == glm::ivec2{} || std::abs(offset.x) >= width || std::abs(offset.y) >= height)
+			return;
+
+		const int srcX = std::max(0, -offset.x), dstX = std::max(0, offset.x);
+		const auto rowSize = static_cast<std::size_t>(width - std::abs(offset.x)) * sizeof(RGBA8);
+		const auto moveRow = [&](int y) { std::memmove(&image[y + offset.y, dstX], &image[y, srcX], rowSize); };
+
+		// Rows are moved starting from the side they are moving to, so none is overwritten before it's moved
+		if (offset.y > 0) {
+			for (int y = height - 1 - offset.y; y >= 0; --y)
+				moveRow(y);
+		} else {
+			for (int y = -offset.y; y < height; ++y)
+				moveRow(y);
+		}
+		m_dirty = true;
+	}
+
+	// Must be called after drawing through FramebufferRef, otherwise the changes won't be uploaded
+	void markDirty() noexcept { m_dirty = true; }
 
-	void commitToGpu() { sg_update_image(m_image, sg_image_data{{{.ptr = m_data.data(), .size = m_data.size() * sizeof(RGBA8)}}}); }
+	// Sokol can only replace the whole image, so the upload is skipped when nothing has changed since the last one
+	void commitToGpu() {
+		if (!std::exchange(m_dirty, false))
+			return;
+
+		const auto pixels = m_pixels.pixels();
+		sg_update_image(m_image, sg_image_data{{{.ptr = pixels.data(), .size = pixels.size_bytes()}}});
+	}
 
     [[nodiscard]] const SgUniqueImageWithView& getImage() const & { return m_image; }
     [[nodiscard]] SgUniqueImageWithView getImage() && { return std::move(m_image); }
 
-	operator FramebufferRef() { return m_dataDesc; }
+	operator FramebufferRef() { return m_pixels; }
 
 private:
 	SgUniqueImageWithView m_image;
-	std::vector<RGBA8> m_data;
-	FramebufferRef m_dataDesc;
+	PixelBuffer m_pixels;
+	bool m_dirty = true;
 };
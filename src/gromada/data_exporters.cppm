@@ -3,147 +3,315 @@ module;
 export module Gromada.DataExporters;
 
 import std;
-import utils;
-import nlohmann.json; //TODO: try Glaze instead
 import Gromada.Resources;
 import Gromada.Map;
 
 export { 
 	void ExportMapToJson(std::span<const Vid> vids, const Map& map, std::ostream& stream);
-	void ExportVidsToCsv(std::span<const Vid> vids, std::ostream& stream);
+
+	// Set of the vids CSV columns, the bit i selects the i-th of vidCsvColumnNames(); the index column is always written
+	using VidCsvColumns = std::uint64_t;
+	constexpr VidCsvColumns allVidCsvColumns = ~VidCsvColumns{0};
+
+	std::span<const std::string_view> vidCsvColumnNames();
+	// Comma-separated names like "name,unitType,numOfFrames", throws std::invalid_argument on the unknown ones
+	VidCsvColumns parseVidCsvColumns(std::string_view names);
+
+	void ExportVidsToCsv(std::span<const Vid> vids, std::ostream& stream, VidCsvColumns columns = allVidCsvColumns);
 }
 
 
+namespace {
+	// Writes JSON straight to the stream without building a document, commas are placed automatically.
+	// Keys should be written in the sorted order, the same nlohmann::json keeps them in
+	class JsonStreamWriter {
+	public:
+		explicit JsonStreamWriter(std::ostream& stream) : m_stream{stream} {}
+
+		void beginObject() { beginValue(); put("{"); m_hasElements.push_back(false); }
+		void endObject() { m_hasElements.pop_back(); put("}"); }
+		void beginArray() { beginValue(); put("["); m_hasElements.push_back(false); }
+		void endArray() { m_hasElements.pop_back(); put("]"); }
+
+		// Keys are identifiers, there is nothing to escape
+		void key(std::string_view name) {
+			beginValue();
+			put("\"");
+			put(name);
+			put("\":");
+			m_isAfterKey = true;
+		}
+
+		template <typename T>
+		requires std::is_integral_v<T>
+		void value(T number) {
+			beginValue();
+			std::array<char, 24> buffer;
+			const auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), number);
+			put({buffer.data(), result.ptr});
+		}
+
+		// As the underlying numbers, the same as nlohmann::json does by default
+		template <typename T>
+		requires std::is_enum_v<T>
+		void value(T enumValue) { value(std::to_underlying(enumValue)); }
+
+		void null() { beginValue(); put("null"); }
+
+		void field(std::string_view name, auto number) { key(name); value(number); }
+
+		void array(std::ranges::input_range auto&& range, const auto& writeElement) {
+			beginArray();
+			for (const auto& element : range)
+				writeElement(element);
+			endArray();
+		}
+
+	private:
+		void put(std::string_view text) { m_stream.write(text.data(), static_cast<std::streamsize>(text.size())); }
+
+		void beginValue() {
+			if (std::exchange(m_isAfterKey, false))
+				return;
+			if (m_hasElements.empty())
+				return;
+			if (m_hasElements.back())
+				put(",");
+			m_hasElements.back() = true;
+		}
+
+		std::ostream& m_stream;
+		std::vector<bool> m_hasElements; // of the objects and arrays being written
+		bool m_isAfterKey = false;
+	};
+}
+
+// Output is the same as of the nlohmann::json document dumped compactly, but the objects are written one by one
 void ExportMapToJson(std::span<const Vid> vids, const Map& map, std::ostream& stream) {
-	auto objectToJson = [vids](const GameObject& obj) {
-	    auto payloadToJson = [objectSerializationClass = getObjectSerializationClass(vids[obj.nvid].behave)](const GameObject::Payload& payload) {
-	        switch (objectSerializationClass) {
-	            case ObjectSerializationClass::Static:
-                    return nlohmann::json{{"hp", payload.hp}};
-
-	            case ObjectSerializationClass::Dynamic:
-	                return nlohmann::json{
-					        {"hp", payload.hp},
-                            {"buildTime", payload.buildTime},
-                            {"army", payload.army},
-                            {"behave", payload.behave},
-                            {"items", payload.items},
-                        };
-
-	            default:
-	                return nlohmann::json{}; // No payload or unknown class
-	        }
-	    };
-
-	    auto commandToJson = [](const ObjectCommand& command) {
-	        return nlohmann::json{
-	            {"opcode", command.command},
-	            {"p1", command.p1},
-	            {"p2", command.p2}
-	        };
-	    };
-
-		return nlohmann::json::object({
-			{"nvid", obj.nvid},
-			{"x", obj.x},
-			{"y", obj.y},
-			{"z", obj.z},
-			{"direction", obj.direction},
-			{"payload", payloadToJson(obj.payload)},
-		    {"id", obj.id},
-		    {"commands", obj.payload.commands | std::views::transform(commandToJson) | std::ranges::to<std::vector>()},
+	JsonStreamWriter json{stream};
+	json.beginObject();
+
+	json.key("armies");
+	json.array(map.armies, [&](const Army& army) {
+		json.beginObject();
+		json.field("a", army.a);
+		json.field("b", army.b);
+		json.field("c", army.c);
+		json.field("flagman_id", army.flagman_id);
+		json.key("squads");
+		json.array(army.squads, [&](const Army::Squad& squad) {
+			json.array(squad, [&](std::uint32_t id) { json.value(id); });
 		});
-	};
+		json.endObject();
+	});
 
 	const auto& header = map.header;
-	nlohmann::json document{
-		{"header",
-			nlohmann::json{
-				{"width", header.width},
-				{"height", header.height},
-				{"observerX", header.observerX},
-				{"observerY", header.observerY},
-				{"scaleX", header.scaleX},
-				{"scaleY", header.scaleY},
-				{"startTimer", header.startTimer},
-				{"mapVersion", header.mapVersion},
-			}},
-		{"objects", map.objects | std::views::transform(objectToJson) | std::views::common | std::ranges::to<std::vector>()},
-	};
+	json.key("header");
+	json.beginObject();
+	json.field("height", header.height);
+	json.field("mapVersion", header.mapVersion);
+	json.field("observerX", header.observerX);
+	json.field("observerY", header.observerY);
+	json.field("scaleX", header.scaleX);
+	json.field("scaleY", header.scaleY);
+	json.field("startTimer", header.startTimer);
+	json.field("width", header.width);
+	json.endObject();
+
+	json.key("objects");
+	json.array(map.objects, [&](const GameObject& obj) {
+		json.beginObject();
+		json.key("commands");
+		json.array(obj.payload.commands, [&](const ObjectCommand& command) {
+			json.beginObject();
+			json.field("opcode", command.command);
+			json.field("p1", command.p1);
+			json.field("p2", command.p2);
+			json.endObject();
+		});
+		json.field("direction", obj.direction);
+		json.field("id", obj.id);
+		json.field("nvid", obj.nvid);
+
+		const auto& payload = obj.payload;
+		json.key("payload");
+		switch (getObjectSerializationClass(vids[obj.nvid].behave)) {
+		case ObjectSerializationClass::Static:
+			json.beginObject();
+			json.field("hp", payload.hp);
+			json.endObject();
+			break;
 
-	stream << document;
+		case ObjectSerializationClass::Dynamic:
+			json.beginObject();
+			json.field("army", payload.army);
+			json.field("behave", payload.behave);
+			json.field("buildTime", payload.buildTime);
+			json.field("hp", payload.hp);
+			json.key("items");
+			json.array(payload.items, [&](std::int16_t item) { json.value(item); });
+			json.endObject();
+			break;
+
+		default:
+			json.null(); // No payload or unknown class
+		}
+
+		json.field("x", obj.x);
+		json.field("y", obj.y);
+		json.field("z", obj.z);
+		json.endObject();
+	});
+
+	json.endObject();
 }
 
-template <auto MemberPtr> 
-auto MakePrintFunction() {
-	constexpr static auto Formatter = [](std::ostream& stream, const auto& value) {
+namespace {
+	// A column of the vids CSV, get() returns a value to format
+	template <typename Getter>
+	struct CsvField {
+		std::string_view name;
+		Getter get;
+	};
+
+	template <auto MemberPtr>
+	constexpr auto propertyField(std::string_view name) {
+		return CsvField{name, [](const Vid& vid) { return vid.*MemberPtr; }};
+	}
+
+	// Vids referring to the graphics of another vid have no own header, the cell stays empty
+	template <auto MemberPtr>
+	constexpr auto graphicsField(std::string_view name) {
+		return CsvField{name, [](const Vid& vid) {
+			const auto* graphics = std::get_if<Vid::Graphics>(&vid.graphicsData);
+			return graphics && *graphics ? std::optional{(*graphics)->header().*MemberPtr} : std::nullopt;
+		}};
+	}
+
+	constexpr auto vidCsvFields = std::tuple{
+		CsvField{"name", [](const Vid& vid) { return std::string_view{vid.name.data(), std::char_traits<char>::find(vid.name.data(), vid.name.size(), '\0')}; }},
+		CsvField{"unitType", [](const Vid& vid) { return to_string(vid.unitType); }},
+		propertyField<&Vid::behave>("behave"),
+		propertyField<&Vid::flags>("flags"),
+		propertyField<&Vid::collisionMask>("collisionMask"),
+		propertyField<&Vid::sizeX>("sizeX"),
+		propertyField<&Vid::sizeY>("sizeY"),
+		propertyField<&Vid::sizeZ>("sizeZ"),
+		propertyField<&Vid::maxHP>("maxHP"),
+		propertyField<&Vid::visibilityRadius>("gridRadius"),
+		propertyField<&Vid::unused1>("unused1"),
+		propertyField<&Vid::speedX>("speedX"),
+		propertyField<&Vid::speedY>("speedY"),
+		propertyField<&Vid::acceleration>("acceleration"),
+		propertyField<&Vid::rotationPeriod>("rotationPeriod"),
+		propertyField<&Vid::army>("army"),
+		propertyField<&Vid::someWeaponIndex>("someWeaponIndex"),
+		propertyField<&Vid::unused2>("unused2"),
+		propertyField<&Vid::deathDamageRadius>("deathDamageRadius"),
+		propertyField<&Vid::deathDamage>("deathDamage"),
+		propertyField<&Vid::linkX>("linkX"),
+		propertyField<&Vid::linkY>("linkY"),
+		propertyField<&Vid::linkZ>("linkZ"),
+		propertyField<&Vid::linkedObjectVid>("linkedObjectVid"),
+		propertyField<&Vid::unused3>("unused3"),
+		propertyField<&Vid::directionsCount>("Directions count"),
+		propertyField<&Vid::z_layer>("z_layer"),
+		propertyField<&Vid::dataSizeOrNvid>("dataSizeOrNvid"),
+		graphicsField<&VidGraphicsHeader::dataFormat>("dataFormat"),
+		graphicsField<&VidGraphicsHeader::frameDuration>("frameDuration"),
+		graphicsField<&VidGraphicsHeader::numOfFrames>("numOfFrames"),
+		graphicsField<&VidGraphicsHeader::dataSize>("dataSize"),
+		graphicsField<&VidGraphicsHeader::width>("width"),
+		graphicsField<&VidGraphicsHeader::height>("height"),
+	};
+	constexpr auto vidCsvFieldIndices = std::make_index_sequence<std::tuple_size_v<decltype(vidCsvFields)>>{};
+	static_assert(std::tuple_size_v<decltype(vidCsvFields)> <= std::numeric_limits<VidCsvColumns>::digits, "Columns don't fit the mask");
+
+	constexpr auto vidCsvFieldNames = std::apply([](const auto&... fields) { return std::array{fields.name...}; }, vidCsvFields);
+
+	void formatCsvValue(std::string& out, const auto& value) {
 		using ValueType = std::decay_t<decltype(value)>;
-		if constexpr (std::ranges::contiguous_range<ValueType>) {
-			stream << std::string_view{value.data(), std::char_traits<char>::find(value.data(), value.size(), '\0')};
+		if constexpr (std::is_same_v<ValueType, std::string_view>) {
+			// Quoted only if needed, so the names stay as they are in the most cases
+			if (value.find_first_of(",\"\n") == std::string_view::npos) {
+				out += value;
+				return;
+			}
+			out += '"';
+			for (const char c : value) {
+				if (c == '"')
+					out += '"';
+				out += c;
+			}
+			out += '"';
 		}
-		else if constexpr (std::is_integral_v<ValueType>) {
-			stream << +value;
+		else if constexpr (requires { value.has_value(); }) {
+			if (value)
+				formatCsvValue(out, *value);
+		}
+		else if constexpr (std::is_enum_v<ValueType>) {
+			formatCsvValue(out, std::to_underlying(value));
 		}
 		else {
-			stream << "???";
+			// Promoted, so the 8-bit numbers aren't written as characters
+			std::format_to(std::back_inserter(out), "{}", +value);
 		}
-	};
+	}
 
-	return std::function {
-		[](std::ostream& stream, std::add_const_t<type_from_member_t<decltype(MemberPtr)>> obj) { Formatter(stream, std::invoke(MemberPtr, obj)); }
-	};
+	// Expands into the checks of the mask and the inlined formatting of every field, without any indirect calls
+	template <std::size_t... Indices>
+	void formatVidCsvRow(std::string& out, std::size_t index, const Vid& vid, VidCsvColumns columns, std::index_sequence<Indices...>) {
+		std::format_to(std::back_inserter(out), "{}", index);
+		([&] {
+			if (columns & VidCsvColumns{1} << Indices) {
+				out += ',';
+				formatCsvValue(out, std::get<Indices>(vidCsvFields).get(vid));
+			}
+		}(), ...);
+		out += '\n';
+	}
 }
 
+std::span<const std::string_view> vidCsvColumnNames() {
+	return vidCsvFieldNames;
+}
 
-void ExportVidsToCsv(std::span<const Vid> vids, std::ostream& stream) {
-	static std::initializer_list<std::pair<std::string_view, std::function<void(std::ostream&, const Vid&)>>> printFunctions = {
-		{"name", MakePrintFunction<&Vid::name>()},
-		{"unitType", MakePrintFunction<&Vid::unitType>()},
-		{"behave", MakePrintFunction<&Vid::behave>()},
-		{"flags", MakePrintFunction<&Vid::flags>()},
-		{"collisionMask", MakePrintFunction<&Vid::collisionMask>()},
-		{"sizeX", MakePrintFunction<&Vid::sizeX>()},
-		{"sizeY", MakePrintFunction<&Vid::sizeY>()},
-		{"sizeZ", MakePrintFunction<&Vid::sizeZ>()},
-		{"maxHP", MakePrintFunction<&Vid::maxHP>()},
-		{"gridRadius", MakePrintFunction<&Vid::visibilityRadius>()},
-		{"unused1", MakePrintFunction<&Vid::unused1>()},
-		{"speedX", MakePrintFunction<&Vid::speedX>()},
-		{"speedY", MakePrintFunction<&Vid::speedY>()},
-		{"acceleration", MakePrintFunction<&Vid::acceleration>()},
-		{"rotationPeriod", MakePrintFunction<&Vid::rotationPeriod>()},
-		{"army", MakePrintFunction<&Vid::army>()},
-		{"someWeaponIndex", MakePrintFunction<&Vid::someWeaponIndex>()},
-		{"unused2", MakePrintFunction<&Vid::unused2>()},
-		{"deathDamageRadius", MakePrintFunction<&Vid::deathDamageRadius>()},
-		{"deathDamage", MakePrintFunction<&Vid::deathDamage>()},
-		{"linkX", MakePrintFunction<&Vid::linkX>()},
-		{"linkY", MakePrintFunction<&Vid::linkY>()},
-		{"linkZ", MakePrintFunction<&Vid::linkZ>()},
-		{"linkedObjectVid", MakePrintFunction<&Vid::linkedObjectVid>()},
-		{"unused3", MakePrintFunction<&Vid::unused3>()},
-		{"Directions count", MakePrintFunction<&Vid::directionsCount>()},
-		{"z_layer", MakePrintFunction<&Vid::z_layer>()},
-		{"dataSizeOrNvid", MakePrintFunction<&Vid::dataSizeOrNvid>()},
-		//{"dataFormat", MakePrintFunction<VidGraphics, &VidGraphics::dataFormat>()},
-		//{"frameDuration", MakePrintFunction<VidGraphics, &VidGraphics::frameDuration>()},
-		//{"numOfFrames", MakePrintFunction<VidGraphics, &VidGraphics::numOfFrames>()},
-		//{"dataSize", MakePrintFunction<VidGraphics, &VidGraphics::dataSize>()},
-		//{"width", MakePrintFunction<VidGraphics, &VidGraphics::width>()},
-		//{"height", MakePrintFunction<VidGraphics, &VidGraphics::height>()},
-	};
+VidCsvColumns parseVidCsvColumns(std::string_view names) {
+	VidCsvColumns columns = 0;
+	for (const auto name : names | std::views::split(',')) {
+		const std::string_view nameView{name.begin(), name.end()};
+		const auto it = std::ranges::find(vidCsvFieldNames, nameView);
+		if (it == vidCsvFieldNames.end())
+			throw std::invalid_argument(std::format("Unknown CSV column \"{}\"", nameView));
 
-	for (const auto& [name, _] : printFunctions) {
-		stream << name << ',';
+		columns |= VidCsvColumns{1} << (it - vidCsvFieldNames.begin());
 	}
+	return columns;
+}
+
+void ExportVidsToCsv(std::span<const Vid> vids, std::ostream& stream, VidCsvColumns columns) {
+	// Rows are formatted into the buffer, which goes to the stream in large blocks
+	constexpr std::size_t flushSize = 64 * 1024;
+	std::string buffer;
+	buffer.reserve(flushSize + 1024);
+	const auto flush = [&] {
+		stream.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+		buffer.clear();
+	};
 
-	for (int index = 0; const auto& vid : vids) {
-		stream << index;
-		for (const auto& [_, printFunction] : printFunctions) {
-			stream << ',';
-			printFunction(stream, vid);
+	buffer += "index";
+	for (std::size_t i = 0; i < vidCsvFieldNames.size(); ++i) {
+		if (columns & VidCsvColumns{1} << i) {
+			buffer += ',';
+			formatCsvValue(buffer, vidCsvFieldNames[i]);
 		}
-		stream << '\n';
-		index++;
 	}
-}
\ No newline at end of file
+	buffer += '\n';
+
+	for (std::size_t index = 0; index < vids.size(); ++index) {
+		formatVidCsvRow(buffer, index, vids[index], columns, vidCsvFieldIndices);
+		if (buffer.size() >= flushSize)
+			flush();
+	}
+	flush();
+}
@@ -6,6 +6,8 @@ export module Gromada.GameResources;
 
 import std;
 import Gromada.ResourceReader;
+import Gromada.ResourcesCache;
+import thread_pool;
 
 export import Gromada.Resources;
 export import Gromada.Resources.Sound;
@@ -13,6 +15,12 @@ export import Gromada.Resources.Sound;
 export {
 	class GameResources;
 
+	struct GameResourcesOptions {
+		GraphicsLoading graphicsLoading = GraphicsLoading::Lazy;
+		// Sidecar file with already parsed resources, it's rebuilt when doesn't match the resource file
+		std::optional<std::filesystem::path> cachePath;
+	};
+
 	// NOTE: in current implementation VidRefs are bound to the GameResources lifetime!
 	class VidRef {
 	public:
@@ -44,7 +52,7 @@ export {
 
 	class GameResources {
 	public:
-	    explicit GameResources(std::filesystem::path path);
+	    explicit GameResources(std::filesystem::path path, const GameResourcesOptions& options = {});
 		GameResources(const GameResources& ) = delete;
 		GameResources& operator=(GameResources&) = delete;
 
@@ -69,6 +77,8 @@ export {
 
 	private:
 	    std::filesystem::path m_gamePath;
+	    // Vids graphics refer directly to the mapped file, so it should outlive them
+	    std::shared_ptr<const MappedFile> m_resourceFile;
 
 	    AdjacencyData m_adjacencyData;
 	    std::vector<VidRef> m_baseTilesVids;
@@ -82,11 +92,73 @@ export {
 // Implementation
 
 
-GameResources::GameResources(std::filesystem::path path)
+namespace {
+	// Keeps an error of a parsing job to rethrow it later, at the same point where the sequential parsing would throw it
+	template <typename T>
+	struct DeferredResult {
+		T value;
+		std::exception_ptr error;
+
+		void run(std::invocable auto&& fn) try {
+			value = fn();
+		} catch (...) {
+			error = std::current_exception();
+		}
+
+		T& get() {
+			if (error)
+				std::rethrow_exception(error);
+			return value;
+		}
+	};
+}
+
+GameResources::GameResources(std::filesystem::path path, const GameResourcesOptions& options)
 	: m_gamePath(path.parent_path()) {
 
-	GromadaResourceNavigator navigator {GromadaResourceReader{std::move(path)}};
-	navigator.visitSectionsOfType(SectionType::Vid, [this](const Section& _, BinaryStreamReader reader) { m_vids.emplace_back(reader); });
+	GromadaResourceNavigator navigator {GromadaResourceReader{path, GromadaResourceReader::ReadMode::Mapped}};
+	m_resourceFile = navigator.mapping();
+
+	std::vector<DeferredResult<AdjacencyData>> adjacencyResults;
+	std::vector<DeferredResult<std::vector<SoundData>>> soundResults;
+
+	auto cachedData = options.cachePath ? loadResourcesCache(*options.cachePath, path, navigator, options.graphicsLoading) : std::nullopt;
+	if (cachedData) {
+		m_vids = std::move(cachedData->vids);
+		if (cachedData->adjacencyData)
+			adjacencyResults.push_back({.value = std::move(*cachedData->adjacencyData)});
+		if (cachedData->sounds)
+			soundResults.push_back({.value = std::move(*cachedData->sounds)});
+	} else {
+		const auto sectionsOfType = [&](SectionType sectionType) {
+			return navigator.getSections()
+				| std::views::filter([sectionType](const Section& section) { return section.header().type == sectionType; })
+				| std::views::transform([](const Section& section) { return &section; })
+				| std::ranges::to<std::vector>();
+		};
+
+		// All the sections are parsed in a single batch, vids go first to keep their errors reported before the others
+		auto jobs = sectionsOfType(SectionType::Vid);
+		const auto numVids = jobs.size();
+		const auto tilesSections = sectionsOfType(SectionType::TilesTable);
+		const auto soundSections = sectionsOfType(SectionType::Sound);
+		jobs.insert(jobs.end(), tilesSections.begin(), tilesSections.end());
+		jobs.insert(jobs.end(), soundSections.begin(), soundSections.end());
+
+		m_vids.resize(numVids);
+		adjacencyResults.resize(tilesSections.size());
+		soundResults.resize(soundSections.size());
+
+		navigator.visitSectionsInParallel(ThreadPool::shared(), jobs, [&](std::size_t index, const Section& section, BinaryStreamReader reader) {
+			if (index < numVids) {
+				m_vids[index] = Vid{reader, options.graphicsLoading};
+			} else if (index -= numVids; index < adjacencyResults.size()) {
+				adjacencyResults[index].run([&] { return getAdjacencyData(section, reader); });
+			} else {
+				soundResults[index - adjacencyResults.size()].run([&] { return getSounds(section, reader); });
+			}
+		});
+	}
 
 	std::ranges::for_each(m_vids, [this](Vid& vid) {
 		if (const auto referenceNvid = std::get_if<std::int32_t>(&vid.graphicsData)) {
@@ -99,19 +171,28 @@ GameResources::GameResources(std::filesystem::path path)
 
 	m_vidRefs = m_vids | std::views::transform([this](const Vid& vid) { return VidRef{*this, &vid}; }) | std::ranges::to<std::vector>();
 
-	navigator.visitSectionsOfType(SectionType::TilesTable, [&](const Section& section, BinaryStreamReader reader) {
-		m_adjacencyData = getAdjacencyData(section, reader);
+	for (auto& adjacencyResult : adjacencyResults) {
+		m_adjacencyData = std::move(adjacencyResult.get());
 		m_baseTilesVids = std::views::iota(0, std::min<int>(adjacencyData().extent(0), adjacencyData().extent(1)))
 		| std::views::transform([this](int i) {
 			auto nvid = std::abs(adjacencyData()[i, i]);
 			return nvid ? getVid(nvid) : VidRef{};
 		})
 		| std::ranges::to<std::vector>();
-	});
+	}
 
-	navigator.visitSectionsOfType(SectionType::Sound, [this](const Section& section, BinaryStreamReader reader) {
-		m_sounds = getSounds(section, reader);
-	});
+	for (auto& soundResult : soundResults) {
+		m_sounds = std::move(soundResult.get());
+	}
+
+	if (options.cachePath && !cachedData) {
+		try {
+			saveResourcesCache(*options.cachePath, path, navigator, m_vids, adjacencyResults.empty() ? nullptr : &m_adjacencyData);
+		} catch (const std::exception& e) {
+			// The cache is just an optimization, resources are loaded anyway
+			std::cerr << "Failed to save resources cache " << options.cachePath->generic_string() << ": " << e.what() << std::endl;
+		}
+	}
 }
 
 VidRef::VidRef(const GameResources& resources, const Vid* vid)
@@ -5,7 +5,9 @@ export module Gromada.GraphicsDecoder;
 
 import std;
 import Gromada.Resources;
+import Gromada.GraphicsFormat;
 import engine.bounding_box;
+import utils;
 
 export {
     using IndexedColor = std::byte;
@@ -16,12 +18,17 @@ export {
 		std::uint16_t a : 1;
 
 		[[nodiscard]] constexpr ColorRgb8 to_rgb8() const noexcept {
-            return {
-                static_cast<std::uint8_t>(r * 255 / 31),
-                static_cast<std::uint8_t>(g * 255 / 31),
-                static_cast<std::uint8_t>(b * 255 / 31)
-            };
+            return {expand_5bit[r], expand_5bit[g], expand_5bit[b]};
         }
+
+    private:
+        // x * 255 / 31 for every 5-bit value
+        static constexpr std::array<std::uint8_t, 32> expand_5bit = [] {
+            std::array<std::uint8_t, 32> table {};
+            for (int i = 0; i < 32; ++i)
+                table[i] = static_cast<std::uint8_t>(i * 255 / 31);
+            return table;
+        }();
     };
     static_assert(sizeof(CompressedColor) == sizeof(std::uint16_t));
 
@@ -61,82 +68,92 @@ void Decode_mode0(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderV
     }
 }
 
-void Decode_mode2(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderVisitor auto visitor) {
+// Calls decodeRow(reader, y) for every visible row of the row-compressed frame, reader starts at the row's control stream
+void DecodeCompressedRows(const VidGraphics::Frame& frame, const ClippingInfo& clipping_info, std::invocable<SpanStreamReader&, int> auto decodeRow) {
     auto reader = frame.read();
     const int startY = static_cast<int>(reader.read<std::uint16_t>());
-    const int endY = std::min(reader.read<std::uint16_t>() + startY, clipping_info.last_y);
-
-    struct ControlWord {
-        std::uint8_t count : 6;
-        std::uint8_t command : 2;
-    };
-    static_assert(sizeof (ControlWord) == sizeof (std::uint8_t));
+    const int numRows = static_cast<int>(reader.read<std::uint16_t>());
+    // Offsets come from the resource file or its cache, so they are checked in the release builds too
+    if (frame.rowOffsets.size() != static_cast<std::size_t>(numRows))
+        throw std::runtime_error("DecodeCompressedRows: rows index doesn't match the frame");
+
+    const int beginY = std::max(startY, clipping_info.skip_first_y);
+    const int endY = std::min(startY + numRows, clipping_info.last_y);
+    for (int y = beginY; y < endY; ++y) {
+        const auto rowOffset = frame.rowOffsets[y - startY];
+        if (rowOffset > frame.data.size())
+            throw std::overflow_error("DecodeCompressedRows: row is out of frame data");
+
+        SpanStreamReader rowReader{frame.data.subspan(rowOffset)};
+        decodeRow(rowReader, y);
+    }
+}
 
-    for (int y = startY; y < endY; ++y) {
+// Runs which end before skip_first_x are just skipped, and the rest of the row is dropped after last_x
+void Decode_mode2(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderVisitor auto visitor) {
+    DecodeCompressedRows(frame, clipping_info, [&](SpanStreamReader& reader, int y) {
         visitor.set_cursor(0, y);
-        for (ControlWord command; command = reader.read<ControlWord>(), command.count != 0;) {
+        for (int x = 0; x < clipping_info.last_x;) {
+            const auto command = reader.read<Mode2ControlWord>();
+            if (command.count == 0)
+                break;
+
+            const bool visible = x + command.count > clipping_info.skip_first_x;
             switch (command.command) {
             case 0:
                 visitor.advance_cursor(command.count); break;
             case 1:
-                visitor.draw_pixels_shadow( command.count); break;
-            case 2:
-                visitor.draw_pixels_indexed( reader.read_bytes(command.count)); break;
-            case 3:
-                visitor.draw_pixels_repeat( command.count, reader.read<IndexedColor>()); break;
+                visible ? visitor.draw_pixels_shadow( command.count) : visitor.advance_cursor(command.count); break;
+            case 2: {
+                const auto colors = reader.read_bytes(command.count);
+                visible ? visitor.draw_pixels_indexed(colors) : visitor.advance_cursor(command.count); break;
+            }
+            case 3: {
+                const auto color = reader.read<IndexedColor>();
+                visible ? visitor.draw_pixels_repeat( command.count, color) : visitor.advance_cursor(command.count); break;
+            }
             default:
                 std::unreachable();
             }
+            x += command.count;
         }
-    }
+    });
 }
 
 void Decode_mode3(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderVisitor auto visitor) {
-    auto reader = frame.read();
-    const int startY = static_cast<int>(reader.read<std::uint16_t>());
-    const int endY = std::min(reader.read<std::uint16_t>() + startY, clipping_info.last_y);
-
-    struct ControlWord {
-		std::uint8_t count : 5;
-		std::uint8_t factor : 3;
-	};
-    static_assert(sizeof (ControlWord) == sizeof (std::uint8_t));
-
-    for (int y = startY; y < endY; ++y) {
+    DecodeCompressedRows(frame, clipping_info, [&](SpanStreamReader& reader, int y) {
         visitor.set_cursor(0, y);
-        for (ControlWord command; command = reader.read<ControlWord>(), command.count != 0;) {
-            if (command.factor) {
+        for (int x = 0; x < clipping_info.last_x;) {
+            const auto command = reader.read<Mode3ControlWord>();
+            if (command.count == 0)
+                break;
+
+            if (command.factor && x + command.count > clipping_info.skip_first_x) {
                 visitor.draw_pixels_light(command.count, command.factor, command.factor, command.factor);
             } else {
                 visitor.advance_cursor(command.count);
             }
+            x += command.count;
         }
-    }
+    });
 }
 
 void Decode_mode4(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderVisitor auto visitor) {
-    auto reader = frame.read();
-    const int startY = static_cast<int>(reader.read<std::uint16_t>());
-    const int endY = std::min(reader.read<std::uint16_t>() + startY, clipping_info.last_y);
-
-    struct ControlWord {
-        std::uint16_t count : 7;
-		std::uint16_t b_factor : 3;
-		std::uint16_t g_factor : 3;
-		std::uint16_t r_factor : 3;
-	};
-    static_assert(sizeof (ControlWord) == sizeof (std::uint16_t));
-
-    for (int y = startY; y < endY; ++y) {
+    DecodeCompressedRows(frame, clipping_info, [&](SpanStreamReader& reader, int y) {
         visitor.set_cursor(0, y);
-        for (ControlWord command; command = reader.read<ControlWord>(), command.count > 0;) {
-            if (command.r_factor != 0 || command.g_factor != 0 || command.b_factor != 0) {
+        for (int x = 0; x < clipping_info.last_x;) {
+            const auto command = reader.read<Mode4ControlWord>();
+            if (command.count == 0)
+                break;
+
+            if ((command.r_factor != 0 || command.g_factor != 0 || command.b_factor != 0) && x + command.count > clipping_info.skip_first_x) {
                 visitor.draw_pixels_light( command.count, command.r_factor, command.g_factor, command.b_factor);
             } else {
                 visitor.advance_cursor(command.count);
             }
+            x += command.count;
         }
-    }
+    });
 }
 
 void Decode_mode6(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderVisitor auto visitor) {
@@ -169,29 +186,27 @@ void Decode_mode6(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderV
 }
 
 void Decode_Type8(VidGraphics::Frame frame, ClippingInfo clipping_info, DecoderVisitor auto visitor) {
-    auto reader = frame.read();
-    const int startY = static_cast<int>(reader.read<std::uint16_t>());
-    const int endY = std::min(reader.read<std::uint16_t>() + startY, clipping_info.last_y);
-
-    struct ControlWord {
-        std::uint8_t count : 5;
-        std::uint8_t opacity : 3;
-    };
-    static_assert(sizeof (ControlWord) == sizeof (std::uint8_t));
-
-    for (int y = startY; y < endY; ++y) {
+    DecodeCompressedRows(frame, clipping_info, [&](SpanStreamReader& reader, int y) {
         visitor.set_cursor(0, y);
-        for (ControlWord command; command = reader.read<ControlWord>(), command.count != 0;) {
-            if (command.opacity == 7) {
-                visitor.draw_pixels_indexed(reader.read_bytes(command.count));
-            } else if (command.opacity != 0) {
-                const std::uint8_t t = 255 - command.opacity * 42;
-                visitor.draw_pixels_alpha_blend( t, reader.read_bytes(command.count));
-            } else {
+        for (int x = 0; x < clipping_info.last_x;) {
+            const auto command = reader.read<Mode8ControlWord>();
+            if (command.count == 0)
+                break;
+
+            const bool visible = x + command.count > clipping_info.skip_first_x;
+            if (command.opacity == 0) {
+                visitor.advance_cursor(command.count);
+            } else if (const auto colors = reader.read_bytes(command.count); !visible) {
                 visitor.advance_cursor(command.count);
+            } else if (command.opacity == 7) {
+                visitor.draw_pixels_indexed(colors);
+            } else {
+                const std::uint8_t t = 255 - command.opacity * 42;
+                visitor.draw_pixels_alpha_blend( t, colors);
             }
+            x += command.count;
         }
-    }
+    });
 }
 
 ClippingInfo::ClippingInfo (BoundingBox source_rect, BoundingBox destination_rect) noexcept
@@ -204,7 +219,7 @@ ClippingInfo::ClippingInfo (BoundingBox source_rect, BoundingBox destination_rec
 {}
 
 void DecodeFrame(const VidGraphics::Frame& frame, DecoderVisitor auto visitor) {
-    // NOTE: Unfortunately data of formats 2, 4, 8 is compressed, so we can do clipping only by last_y
+    // NOTE: formats 2, 3, 4, 8 are compressed, their rows are found with Frame::rowOffsets, and clipped by x run by run
     const auto clipping_info = visitor.begin_image({0, frame.width(), 0, frame.height()});
     assert(clipping_info.skip_last_x >= 0 && clipping_info.skip_first_x >= 0 && clipping_info.skip_last_y >= 0 && clipping_info.skip_first_y >= 0);
     assert(clipping_info.skip_first_x + clipping_info.skip_last_x < frame.width());
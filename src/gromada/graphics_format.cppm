@@ -0,0 +1,89 @@
+export module Gromada.GraphicsFormat;
+
+import std;
+import utils;
+
+export {
+    // Control words of the row-compressed formats, every row is a stream of them terminated by a zero count
+    struct Mode2ControlWord {
+        std::uint8_t count : 6;
+        std::uint8_t command : 2;
+    };
+    static_assert(sizeof (Mode2ControlWord) == sizeof (std::uint8_t));
+
+    struct Mode3ControlWord {
+        std::uint8_t count : 5;
+        std::uint8_t factor : 3;
+    };
+    static_assert(sizeof (Mode3ControlWord) == sizeof (std::uint8_t));
+
+    struct Mode4ControlWord {
+        std::uint16_t count : 7;
+        std::uint16_t b_factor : 3;
+        std::uint16_t g_factor : 3;
+        std::uint16_t r_factor : 3;
+    };
+    static_assert(sizeof (Mode4ControlWord) == sizeof (std::uint16_t));
+
+    struct Mode8ControlWord {
+        std::uint8_t count : 5;
+        std::uint8_t opacity : 3;
+    };
+    static_assert(sizeof (Mode8ControlWord) == sizeof (std::uint8_t));
+
+    // Frames of these formats start with the first row number and the number of rows, followed by the rows' control streams
+    constexpr bool isRowCompressedFormat(std::uint8_t dataFormat) noexcept {
+        return dataFormat == 2 || dataFormat == 3 || dataFormat == 4 || dataFormat == 8;
+    }
+
+    // Offsets of every row's control stream from the beginning of the frame data, so rows could be decoded in any order.
+    // Empty for the formats that aren't row-compressed.
+    std::vector<std::uint32_t> indexFrameRows(std::uint8_t dataFormat, std::span<const std::byte> frameData);
+}
+
+
+// Implementation
+
+void SkipRow(std::uint8_t dataFormat, SpanStreamReader& reader) {
+    switch (dataFormat) {
+    case 2:
+        for (Mode2ControlWord command; command = reader.read<Mode2ControlWord>(), command.count != 0;) {
+            if (command.command == 2)
+                reader.skip(command.count);
+            else if (command.command == 3)
+                reader.skip(1);
+        }
+        return;
+    case 3:
+        while (reader.read<Mode3ControlWord>().count != 0) {}
+        return;
+    case 4:
+        while (reader.read<Mode4ControlWord>().count != 0) {}
+        return;
+    case 8:
+        for (Mode8ControlWord command; command = reader.read<Mode8ControlWord>(), command.count != 0;) {
+            if (command.opacity != 0)
+                reader.skip(command.count);
+        }
+        return;
+    default:
+        std::unreachable();
+    }
+}
+
+std::vector<std::uint32_t> indexFrameRows(std::uint8_t dataFormat, std::span<const std::byte> frameData) {
+    if (!isRowCompressedFormat(dataFormat))
+        return {};
+
+    SpanStreamReader reader{frameData};
+    [[maybe_unused]] const auto startY = reader.read<std::uint16_t>();
+    const auto numRows = reader.read<std::uint16_t>();
+
+    std::vector<std::uint32_t> rowOffsets(numRows);
+    for (auto& rowOffset : rowOffsets) {
+        rowOffset = static_cast<std::uint32_t>(frameData.size() - reader.bytesRemaining());
+        SkipRow(dataFormat, reader);
+    }
+
+    return rowOffsets;
+}
@@ -12,6 +12,8 @@ export {
     struct ObjectCommand {
         Action command;
         std::uint32_t p1, p2;
+
+        bool operator==(const ObjectCommand&) const = default;
     };
 
     struct GameObject {
@@ -34,9 +36,13 @@ export {
             std::uint8_t army = 0; // Real default is vid[nvid].army
             std::uint8_t behave = 1;
             std::vector<std::int16_t> items;
+
+            bool operator==(const Payload&) const = default;
         } payload;
 
         std::uint32_t id; // Unique ID for the object, used as a target for some commands and map armies info
+
+        bool operator==(const GameObject&) const = default;
     };
 
     enum /*class*/ MapVersion : std::uint32_t {
@@ -55,6 +61,8 @@ export {
         std::uint32_t scaleY = 16;
         std::uint32_t startTimer = 0;
         MapVersion mapVersion = MapVersion::V3;
+
+        bool operator==(const MapHeaderRawData&) const = default;
     };
 
     struct Army {
@@ -62,6 +70,8 @@ export {
         std::uint32_t a, b, c;
         std::uint32_t flagman_id;
         std::vector<Squad> squads;
+
+        bool operator==(const Army&) const = default;
     };
 
     struct Map
@@ -71,9 +81,27 @@ export {
         std::array<Army, 2> armies;
     };
 
-    Map loadMap(std::span<const Vid> vids, const std::filesystem::path& path);
+    // Shared with the thread which loads the map
+    struct MapLoadProgress {
+        std::atomic<float> fraction = 0.0f; // in [0, 1]
+        std::atomic<bool> cancelled = false; // loading stops with MapLoadCancelled as soon as it notices
+    };
+
+    class MapLoadCancelled : public std::runtime_error {
+    public:
+        MapLoadCancelled() : std::runtime_error{"Map loading is cancelled"} {}
+    };
+
+    Map loadMap(std::span<const Vid> vids, const std::filesystem::path& path, MapLoadProgress* progress = nullptr);
+    // Map file's content in memory
+    Map loadMap(std::span<const Vid> vids, std::span<const std::byte> data, MapLoadProgress* progress = nullptr);
     std::vector<GameObject> loadMenu(std::span<const Vid> vids, std::istream&& stream);
+    // Whole content of the map file, built in memory at once
+    std::vector<std::byte> serializeMap(std::span<const Vid> vids, const Map& map);
     void saveMap(std::span<const Vid> vids, const Map& map, std::ostream& stream);
+    // The map is written to a temporary file next to the path first, which then replaces the file,
+    // so the file is never left half-written
+    void saveMap(std::span<const Vid> vids, const Map& map, const std::filesystem::path& path);
 
     enum class ObjectSerializationClass : std::uint8_t {
         Unknown,
@@ -0,0 +1,186 @@
+module;
+#include <cassert>
+
+export module Gromada.MapGenerator;
+
+import std;
+
+import Gromada.Actions;
+import Gromada.GameResources;
+import Gromada.Map;
+
+export {
+	// Unit types which objects could be scattered over the map, terrain is laid out as a grid instead
+	constexpr auto generatedUnitTypes = std::to_array<UnitType>({
+		UnitType::Object, UnitType::Monster, UnitType::Avia, UnitType::Cannon, UnitType::Sprite, UnitType::Item,
+	});
+
+	struct MapGeneratorOptions {
+		std::uint32_t seed = 1;
+		// In pixels, the objects' coordinates are 16-bit so the map can't be bigger
+		int width = std::numeric_limits<std::int16_t>::max();
+		int height = std::numeric_limits<std::int16_t>::max();
+		bool terrain = true;
+		// Number of objects of the unit type per 256x256 block of the map
+		std::map<UnitType, float> densities {
+			{UnitType::Object, 4.0f},
+			{UnitType::Monster, 1.0f},
+			{UnitType::Avia, 0.25f},
+			{UnitType::Cannon, 0.25f},
+			{UnitType::Sprite, 0.5f},
+			{UnitType::Item, 0.5f},
+		};
+		// Of a unit to have a few commands
+		float commandsProbability = 0.25f;
+		int maxItems = 3;
+		int squadSize = 8;
+	};
+
+	// Fills the map with random objects of the resources, for the stress tests of the editor, the renderer and the map files.
+	// The same seed and resources give the same map on every platform.
+	Map generateMap(const GameResources& resources, const MapGeneratorOptions& options = {});
+}
+
+
+// Implementation
+namespace {
+	// Only the raw output of the engine is used, the standard distributions differ between the implementations
+	class Random {
+	public:
+		explicit Random(std::uint32_t seed) : m_engine{seed} {}
+
+		// In [0, bound)
+		int operator()(int bound) { return static_cast<int>(m_engine() % static_cast<std::uint32_t>(bound)); }
+		int operator()(int min, int max) { return min + (*this)(max - min + 1); }
+		bool chance(float probability) { return m_engine() < probability * static_cast<float>(std::mt19937::max()); }
+
+		template <typename T>
+		const T& pick(std::span<const T> values) { return values[(*this)(static_cast<int>(values.size()))]; }
+
+	private:
+		std::mt19937 m_engine;
+	};
+
+	// Objects of unknown behavior can't be saved, the loader rejects them
+	std::vector<std::uint16_t> placeableVids(const GameResources& resources, UnitType unitType) {
+		std::vector<std::uint16_t> result;
+		for (const auto& vid : resources.vidRefs()) {
+			if (vid->unitType == unitType && vid->graphicsHeader().numOfFrames > 0
+				&& getObjectSerializationClass(vid->behave) != ObjectSerializationClass::Unknown)
+				result.push_back(vid.nvid());
+		}
+		return result;
+	}
+
+	void generateTerrain(const GameResources& resources, const MapGeneratorOptions& options, Random& random, std::vector<GameObject>& objects) {
+		auto tiles = resources.baseTilesVids()
+			| std::views::filter([](const VidRef& vid) { return static_cast<bool>(vid); })
+			| std::views::transform([](const VidRef& vid) { return vid.nvid(); })
+			| std::ranges::to<std::vector>();
+		if (tiles.empty())
+			tiles = placeableVids(resources, UnitType::Terrain);
+		if (tiles.empty())
+			return;
+
+		// All the base tiles have the same size, the first one defines the grid
+		const auto& tile = resources.getVid(tiles.front());
+		const int stepX = tile->sizeX ? tile->sizeX : tile->graphicsHeader().width;
+		const int stepY = tile->sizeY ? tile->sizeY : tile->graphicsHeader().height;
+		if (stepX <= 0 || stepY <= 0)
+			return;
+
+		for (int y = stepY / 2; y < options.height; y += stepY) {
+			for (int x = stepX / 2; x < options.width; x += stepX) {
+				objects.push_back({
+					.nvid = random.pick(std::span<const std::uint16_t>{tiles}),
+					.x = static_cast<std::int16_t>(x),
+					.y = static_cast<std::int16_t>(y),
+					.z = 0,
+					.direction = static_cast<std::uint8_t>(random(256)),
+				});
+			}
+		}
+	}
+}
+
+Map generateMap(const GameResources& resources, const MapGeneratorOptions& options) {
+	constexpr int maxCoordinate = std::numeric_limits<std::int16_t>::max();
+	if (options.width <= 0 || options.height <= 0 || options.width > maxCoordinate || options.height > maxCoordinate)
+		throw std::invalid_argument(std::format("generateMap: map size should be in [1, {}]", maxCoordinate));
+	if (options.squadSize <= 0 || options.maxItems < 0)
+		throw std::invalid_argument("generateMap: squads should have units and items count can't be negative");
+
+	Random random {options.seed};
+	Map map {.header = {
+		.width = static_cast<std::uint32_t>(options.width),
+		.height = static_cast<std::uint32_t>(options.height),
+		.observerX = static_cast<std::int16_t>(options.width / 2),
+		.observerY = static_cast<std::int16_t>(options.height / 2),
+	}};
+
+	if (options.terrain)
+		generateTerrain(resources, options, random, map.objects);
+
+	const auto items = placeableVids(resources, UnitType::Item);
+	const double numBlocks = static_cast<double>(options.width) * options.height / (256.0 * 256.0);
+	std::array<std::vector<std::uint32_t>, 2> armyUnits; // indices of the objects
+
+	for (const auto [unitType, density] : options.densities) {
+		const auto nvids = placeableVids(resources, unitType);
+		if (nvids.empty() || density <= 0.0f)
+			continue;
+
+		const auto count = static_cast<std::size_t>(density * numBlocks);
+		map.objects.reserve(map.objects.size() + count);
+		for (std::size_t i = 0; i < count; ++i) {
+			const auto nvid = random.pick(std::span<const std::uint16_t>{nvids});
+			const auto& vid = resources.vids()[nvid];
+
+			auto& object = map.objects.emplace_back(GameObject{
+				.nvid = nvid,
+				.x = static_cast<std::int16_t>(random(options.width)),
+				.y = static_cast<std::int16_t>(random(options.height)),
+				.z = static_cast<std::int16_t>(unitType == UnitType::Avia ? random(64, 160) : 0),
+				.direction = static_cast<std::uint8_t>(random(256)),
+				.payload = {.hp = vid.maxHP ? vid.maxHP : static_cast<std::uint8_t>(random(1, 255))},
+			});
+
+			if (getObjectSerializationClass(vid.behave) != ObjectSerializationClass::Dynamic)
+				continue;
+
+			object.payload.army = static_cast<std::uint8_t>(random(2));
+			object.payload.behave = vid.behave;
+			if (!items.empty()) {
+				for (int itemIndex = random(options.maxItems + 1); itemIndex > 0; --itemIndex)
+					object.payload.items.push_back(static_cast<std::int16_t>(random.pick(std::span<const std::uint16_t>{items})));
+			}
+			if (random.chance(options.commandsProbability)) {
+				for (int commandIndex = random(1, 3); commandIndex > 0; --commandIndex) {
+					object.payload.commands.push_back({
+						.command = Action::act_go,
+						.p1 = static_cast<std::uint32_t>(random(options.width)),
+						.p2 = static_cast<std::uint32_t>(random(options.height)),
+					});
+				}
+			}
+
+			armyUnits[object.payload.army].push_back(static_cast<std::uint32_t>(map.objects.size() - 1));
+		}
+	}
+
+	// IDs go in the order of objects, zero is reserved as a terminator of the squads lists
+	for (std::size_t i = 0; i < map.objects.size(); ++i)
+		map.objects[i].id = static_cast<std::uint32_t>(i + 1);
+
+	for (std::size_t armyIndex = 0; armyIndex < map.armies.size(); ++armyIndex) {
+		auto& army = map.armies[armyIndex];
+		army = {.a = 0, .b = 0, .c = 0, .flagman_id = 0};
+		for (const auto squad : armyUnits[armyIndex] | std::views::chunk(options.squadSize)) {
+			army.squads.push_back(squad | std::views::transform([&](std::uint32_t index) { return map.objects[index].id; }) | std::ranges::to<std::vector>());
+		}
+		if (!army.squads.empty())
+			army.flagman_id = army.squads.front().front();
+	}
+
+	return map;
+}
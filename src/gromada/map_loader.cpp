@@ -44,34 +44,56 @@ GameObject::Payload readObjectPayload(MapVersion mapVersion, std::uint8_t behavi
     return result;
 }
 
-MapHeaderRawData loadMapInfo(GromadaResourceNavigator& resourceNavigator) {
+// Sections of a map file, sorted out by type in a single walk over the section list,
+// so they're read in the order of their dependencies regardless of the order in the file
+struct MapSections {
+    std::vector<const Section*> mapInfo, objects, objectIds, commands, armies;
+
+    explicit MapSections(std::span<const Section> sections) {
+        for (const auto& section : sections) {
+            switch (section.header().type) {
+            case SectionType::MapInfo: mapInfo.push_back(&section); break;
+            case SectionType::Objects: objects.push_back(&section); break;
+            case SectionType::ObjectsIds: objectIds.push_back(&section); break;
+            case SectionType::Command: commands.push_back(&section); break;
+            case SectionType::Army: armies.push_back(&section); break;
+            default: break;
+            }
+        }
+    }
+};
+
+MapHeaderRawData readMapInfoSection(BinaryStreamReader reader) {
     MapHeaderRawData result;
-	auto readMapHeader = [&](const Section& _, BinaryStreamReader reader) {
-		reader.read_to(result.width);
-		reader.read_to(result.height);
-		reader.read_to(result.observerX);
-		reader.read_to(result.observerY);
-		reader.read_to(result.scaleX);
-		reader.read_to(result.scaleY);
-		reader.read_to(result.startTimer);
-		if (reader.size() < 28) {
-			result.mapVersion = MapVersion::V0;
-			return result;
-		}
-		reader.read_to(result.mapVersion);
-
-		return result;
-	};
+    reader.read_to(result.width);
+    reader.read_to(result.height);
+    reader.read_to(result.observerX);
+    reader.read_to(result.observerY);
+    reader.read_to(result.scaleX);
+    reader.read_to(result.scaleY);
+    reader.read_to(result.startTimer);
+    if (reader.size() < 28) {
+        result.mapVersion = MapVersion::V0;
+        return result;
+    }
+    reader.read_to(result.mapVersion);
 
-    const auto numSections = resourceNavigator.visitSectionsOfType(SectionType::MapInfo, readMapHeader);
-    if (numSections != 1)
-        throw std::runtime_error("Invalid map: should be exactly one map info section");
+    return result;
+}
 
-	return result;
+void reportProgress(MapLoadProgress* progress, float fraction) {
+    if (!progress)
+        return;
+
+    if (progress->cancelled.load(std::memory_order_relaxed))
+        throw MapLoadCancelled{};
+    progress->fraction.store(fraction, std::memory_order_relaxed);
 }
 
 //TODO: use output iterator
-void readDynamicObjectsSection(std::vector<GameObject>& result, MapVersion mapVersion, std::span<const Vid> vids, BinaryStreamReader reader) {
+// onProgress is called every few thousands of objects
+void readDynamicObjectsSection(std::vector<GameObject>& result, MapVersion mapVersion, std::span<const Vid> vids, BinaryStreamReader reader,
+    const std::function<void()>& onProgress = {}) {
 	for (std::uint16_t nvid = 0; nvid = reader.read<std::uint16_t>(), nvid != 0xFFFF;) {
         if (nvid < 0 || nvid >= vids.size()) [[unlikely]]
 	        throw std::runtime_error("Map's object nvid is out of range");
@@ -89,31 +111,48 @@ void readDynamicObjectsSection(std::vector<GameObject>& result, MapVersion mapVe
 		    .action = action,
 			.payload = readObjectPayload(mapVersion, vids[nvid].behave, reader),
 		});
+
+		if (onProgress && result.size() % 4096 == 0)
+		    onProgress();
 	}
 }
 
 void readObjectIdsSection(std::vector<std::uint32_t>& objectIds, BinaryStreamReader reader) {
     const auto count = reader.read<std::uint32_t>();
+    // The count comes from the file, don't let a broken one allocate more than the section could hold
+    if (count > reader.size() / sizeof(std::uint32_t)) [[unlikely]]
+        throw std::runtime_error("Map is probably corrupted: too many object ids");
 
     objectIds.resize(objectIds.size() + count);
     reader.read_to(std::as_writable_bytes(std::span{objectIds}.subspan(objectIds.size() - count)));
 }
 
-void readCommandsSection(std::span<const std::uint32_t> objectIds, std::span<GameObject> objects, BinaryStreamReader reader) {
-    //const std::map<std::uint32_t, std::size_t>& objectsLookup,
+// Object's index by its id, the first object wins if ids are duplicated
+using ObjectsLookup = std::unordered_map<std::uint32_t, std::uint32_t>;
+
+ObjectsLookup makeObjectsLookup(std::span<const std::uint32_t> objectIds) {
+    ObjectsLookup result;
+    result.reserve(objectIds.size());
+    for (std::size_t i = 0; i < objectIds.size(); ++i)
+        result.try_emplace(objectIds[i], static_cast<std::uint32_t>(i));
+
+    return result;
+}
+
+void readCommandsSection(const ObjectsLookup& objectsLookup, std::span<GameObject> objects, BinaryStreamReader reader) {
     auto lookupSubject = [&](std::uint32_t subjectId) -> GameObject& {
-        const auto it = std::ranges::find(objectIds, subjectId);
-        if (it == objectIds.end()) [[unlikely]]
+        const auto it = objectsLookup.find(subjectId);
+        if (it == objectsLookup.end()) [[unlikely]]
             throw std::out_of_range("Invalid object id");
 
-        return objects[std::distance(objectIds.begin(), it)];
+        return objects[it->second];
     };
 
     for (std::uint32_t subjectId; subjectId = reader.read<std::uint32_t>(); ) {
         auto& commandArray = lookupSubject(subjectId).payload.commands;
 
         const auto count = reader.read<std::int32_t>();
-        commandArray.reserve(count);
+        commandArray.reserve(commandArray.size() + std::max(count, 0));
         for (int i = 0; i < count; i++) {
             commandArray.push_back(ObjectCommand {
                 .command = Action{reader.read<std::uint8_t>()},
@@ -124,44 +163,45 @@ void readCommandsSection(std::span<const std::uint32_t> objectIds, std::span<Gam
     }
 }
 
-std::array<Army, 2> loadArmies(GromadaResourceNavigator& resourceNavigator) {
+std::array<Army, 2> readArmySection(BinaryStreamReader reader) {
     std::array<Army, 2> armies;
-    std::size_t numOfSections = resourceNavigator.visitSectionsOfType(
-        SectionType::Army , [&](const Section& _, BinaryStreamReader reader) {
-            if(reader.read<std::uint8_t>() != 2)
-                throw std::runtime_error("Invalid map: should be exactly 2 armies");
-
-            for (auto& army : armies) {
-                reader.read_to(army.a);
-                reader.read_to(army.b);
-                reader.read_to(army.c);
-                reader.read_to(army.flagman_id);
-
-                for (std::uint32_t id = 0; id = reader.read<std::uint32_t>(), id != 0;) {
-                    auto& squad = army.squads.emplace_back();
-                    squad.push_back(id);
-                    for (std::uint32_t memberId = 0; memberId = reader.read<std::uint32_t>(), memberId != 0;) {
-                        squad.push_back(memberId);
-                    }
-                }
+    if(reader.read<std::uint8_t>() != 2)
+        throw std::runtime_error("Invalid map: should be exactly 2 armies");
+
+    for (auto& army : armies) {
+        reader.read_to(army.a);
+        reader.read_to(army.b);
+        reader.read_to(army.c);
+        reader.read_to(army.flagman_id);
+
+        for (std::uint32_t id = 0; id = reader.read<std::uint32_t>(), id != 0;) {
+            auto& squad = army.squads.emplace_back();
+            squad.push_back(id);
+            for (std::uint32_t memberId = 0; memberId = reader.read<std::uint32_t>(), memberId != 0;) {
+                squad.push_back(memberId);
             }
-        });
-
-    if (numOfSections != 1) {
-        throw std::runtime_error("Invalid map: should be exactly one army section");
+        }
     }
 
     return armies;
 }
 
-std::vector<GameObject> loadDynamicObjects(MapVersion mapVersion, std::span<const Vid> vids, GromadaResourceNavigator& resourceNavigator) {
-	std::vector<GameObject> result;
-	resourceNavigator.visitSectionsOfType(
-		SectionType::Objects, [&](const Section& _, BinaryStreamReader reader) { readDynamicObjectsSection(result, mapVersion, vids, reader); });
-
+std::vector<GameObject> loadDynamicObjects(MapVersion mapVersion, std::span<const Vid> vids, GromadaResourceNavigator& resourceNavigator, const MapSections& sections, MapLoadProgress* progress) {
+	// IDs go first: there is exactly one per object, so the objects are allocated at once
 	std::vector<std::uint32_t> objectIds;
-	resourceNavigator.visitSectionsOfType(
-		SectionType::ObjectsIds, [&](const Section& _, BinaryStreamReader reader) { readObjectIdsSection(objectIds, reader); });
+	for (const auto* section : sections.objectIds)
+		readObjectIdsSection(objectIds, resourceNavigator.beginRead(*section));
+	reportProgress(progress, 0.1f);
+
+	std::vector<GameObject> result;
+	result.reserve(objectIds.size());
+	// Objects take almost all the time
+	const auto onObjectsProgress = [&] {
+		reportProgress(progress, 0.1f + 0.8f * result.size() / std::max<std::size_t>(objectIds.size(), 1));
+	};
+	for (const auto* section : sections.objects)
+		readDynamicObjectsSection(result, mapVersion, vids, resourceNavigator.beginRead(*section), progress ? onObjectsProgress : std::function<void()>{});
+	reportProgress(progress, 0.9f);
 
 	if (result.size() != objectIds.size())
 		throw std::runtime_error("Map is probably corrupted: ids not matches to objects");
@@ -171,22 +211,47 @@ std::vector<GameObject> loadDynamicObjects(MapVersion mapVersion, std::span<cons
 		result[i].id = objectIds[i];
 	}
 
-	resourceNavigator.visitSectionsOfType(
-		SectionType::Command, [&](const Section& _, BinaryStreamReader reader) { readCommandsSection(objectIds, std::span{result}, reader); });
+	if (!sections.commands.empty()) {
+		const auto objectsLookup = makeObjectsLookup(objectIds);
+		for (const auto* section : sections.commands)
+			readCommandsSection(objectsLookup, std::span{result}, resourceNavigator.beginRead(*section));
+	}
 
 	return result;
 }
 
-Map loadMap(std::span<const Vid> vids, const std::filesystem::path& path) {
-	GromadaResourceNavigator resourceNavigator{GromadaResourceReader{path}};
+Map readMap(std::span<const Vid> vids, GromadaResourceNavigator& resourceNavigator, MapLoadProgress* progress) {
+	const MapSections sections{resourceNavigator.getSections()};
+
+	if (sections.mapInfo.size() != 1)
+		throw std::runtime_error("Invalid map: should be exactly one map info section");
+	const auto header = readMapInfoSection(resourceNavigator.beginRead(*sections.mapInfo.front()));
 
-	auto header = loadMapInfo(resourceNavigator);
+	auto objects = loadDynamicObjects(header.mapVersion, vids, resourceNavigator, sections, progress);
 
-	return Map{
+	if (sections.armies.size() != 1)
+		throw std::runtime_error("Invalid map: should be exactly one army section");
+
+	Map result{
 		.header = header,
-		.objects = loadDynamicObjects(header.mapVersion, vids, resourceNavigator),
-	    .armies = loadArmies(resourceNavigator),
+		.objects = std::move(objects),
+	    .armies = readArmySection(resourceNavigator.beginRead(*sections.armies.front())),
 	};
+	reportProgress(progress, 1.0f);
+
+	return result;
+}
+
+Map loadMap(std::span<const Vid> vids, const std::filesystem::path& path, MapLoadProgress* progress) {
+	reportProgress(progress, 0.0f);
+	GromadaResourceNavigator resourceNavigator{GromadaResourceReader{path}};
+	return readMap(vids, resourceNavigator, progress);
+}
+
+Map loadMap(std::span<const Vid> vids, std::span<const std::byte> data, MapLoadProgress* progress) {
+	reportProgress(progress, 0.0f);
+	GromadaResourceNavigator resourceNavigator{GromadaResourceReader{data}};
+	return readMap(vids, resourceNavigator, progress);
 }
 
 std::vector<GameObject> loadMenu(std::span<const Vid> vids, std::istream&& stream) {
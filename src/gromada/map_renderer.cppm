@@ -0,0 +1,119 @@
+module;
+#include <cassert>
+
+export module Gromada.MapRenderer;
+
+import std;
+import thread_pool;
+import engine.bounding_box;
+
+import Gromada.Actions;
+import Gromada.GameResources;
+import Gromada.Map;
+import Gromada.SoftwareRenderer;
+import Gromada.VisualLogic;
+
+// Renders the whole map as it looks at the start, without any window or GPU.
+// Every scale x scale block of the map becomes one pixel of the image. The map is drawn by horizontal bands in parallel,
+// so only a band of the full-size map is in the memory at a time.
+export PixelBuffer renderMap(const GameResources& resources, const Map& map, int scale, ThreadPool& pool = ThreadPool::shared());
+
+
+// Implementation
+namespace {
+	struct Sprite {
+		std::uint8_t zLayer;
+		int depth;
+		std::size_t index; // keeps the order of the objects with the same depth
+		const VidGraphics::Frame* frame;
+		int x, y; // of the top-left corner
+	};
+
+	// Linked objects are created the same way as in the editor (see WorldModule)
+	void collectSprites(std::vector<Sprite>& sprites, VidRef vid, int x, int y, int z, std::uint8_t direction, int linkDepth = 0) {
+		constexpr int maxLinkDepth = 8;
+		if (vid->linkedObjectVid > 0 && linkDepth < maxLinkDepth)
+			collectSprites(sprites, vid.parent().getVid(vid->linkedObjectVid), x + vid->linkX, y + vid->linkY, z + vid->linkZ, direction, linkDepth + 1);
+
+		const auto& header = vid->graphicsHeader();
+		if (header.numOfFrames == 0 || header.width == 0 || header.height == 0)
+			return;
+
+		const auto& graphics = vid->graphics();
+		const auto frameRange = getAnimationFrameRange(vid, Action::act_stand, direction);
+		const auto frameIndex = frameRange ? frameRange->first : 0;
+		if (frameIndex >= graphics.frames.size())
+			return;
+
+		sprites.push_back({
+			.zLayer = vid->z_layer,
+			.depth = getDrawingDepth(vid, y, z),
+			.index = sprites.size(),
+			.frame = &graphics.frames[frameIndex],
+			.x = x - header.width / 2,
+			.y = y - header.height / 2 - z,
+		});
+	}
+
+	void downscaleRows(FramebufferRef source, int scale, std::span<RGBA8> destination) {
+		const int width = static_cast<int>(destination.size());
+		for (int x = 0; x < width; ++x) {
+			std::array<int, 4> sum {};
+			int count = 0;
+			for (int sourceY = 0; sourceY < source.extent(0); ++sourceY) {
+				for (int sourceX = x * scale; sourceX < std::min((x + 1) * scale, source.extent(1)); ++sourceX, ++count) {
+					const auto& pixel = source[sourceY, sourceX];
+					sum[0] += pixel.r; sum[1] += pixel.g; sum[2] += pixel.b; sum[3] += pixel.a;
+				}
+			}
+
+			destination[x] = RGBA8{{
+				static_cast<std::uint8_t>(sum[0] / count), static_cast<std::uint8_t>(sum[1] / count), static_cast<std::uint8_t>(sum[2] / count)},
+				static_cast<std::uint8_t>(sum[3] / count)};
+		}
+	}
+}
+
+PixelBuffer renderMap(const GameResources& resources, const Map& map, int scale, ThreadPool& pool) {
+	const int mapWidth = static_cast<int>(map.header.width), mapHeight = static_cast<int>(map.header.height);
+	if (scale < 1)
+		throw std::invalid_argument("renderMap: scale must be positive");
+	if (mapWidth <= 0 || mapHeight <= 0)
+		throw std::invalid_argument("renderMap: map is empty");
+
+	std::vector<Sprite> sprites;
+	sprites.reserve(map.objects.size());
+	for (const auto& object : map.objects)
+		collectSprites(sprites, resources.getVid(object.nvid), object.x, object.y, object.z, object.direction);
+
+	std::ranges::sort(sprites, {}, [](const Sprite& sprite) { return std::tie(sprite.zLayer, sprite.depth, sprite.index); });
+
+	PixelBuffer image {(mapWidth + scale - 1) / scale, (mapHeight + scale - 1) / scale};
+	const FramebufferRef imageRef = image;
+
+	constexpr int bandHeight = 32; // in the image rows
+	const int numBands = (image.height() + bandHeight - 1) / bandHeight;
+	pool.parallelFor(static_cast<std::size_t>(numBands), [&](std::size_t bandIndex) {
+		const int beginRow = static_cast<int>(bandIndex) * bandHeight;
+		const int endRow = std::min(beginRow + bandHeight, image.height());
+		const int top = beginRow * scale;
+		const int bottom = std::min(endRow * scale, mapHeight);
+
+		PixelBuffer band {mapWidth, bottom - top};
+		const auto bandBounds = BoundingBox{0, mapWidth, top, bottom};
+		for (const auto& sprite : sprites) {
+			const auto& header = *sprite.frame->parent;
+			if (BoundingBox::fromPositionAndSize(sprite.x, sprite.y, header.width, header.height).isIntersects(bandBounds))
+				DrawSprite(*sprite.frame, sprite.x, sprite.y - top, band);
+		}
+
+		const FramebufferRef bandRef = band;
+		for (int row = beginRow; row < endRow; ++row) {
+			const int rowTop = row * scale - top;
+			const FramebufferRef sourceRows {&bandRef[rowTop, 0], std::dextents<int, 2>{std::min(scale, band.height() - rowTop), mapWidth}};
+			downscaleRows(sourceRows, scale, std::span{&imageRef[row, 0], static_cast<std::size_t>(image.width())});
+		}
+	});
+
+	return image;
+}
@@ -1,5 +1,6 @@
 module;
 #include <cstdint>
+#include <cassert>
 
 module Gromada.Map;
 
@@ -9,15 +10,16 @@ import Gromada.ResourceReader;
 
 
 // Implementation
+// Writes into the buffer of the whole file, the size of the section is patched in on destruction
 class SectionWriter {
 private:
-    std::ostream& stream;
-    std::streampos sectionStartPos;
-    SectionHeader sectionHeader{};
+    std::vector<std::byte>& buffer;
+    std::size_t sectionStart;
 
 public:
-    SectionWriter(SectionType type, std::uint32_t elementCount, std::ostream& stream)
-        : stream{stream}, sectionStartPos{stream.tellp()}, sectionHeader{.type = type, .elementCount = elementCount, .dataOffset = 0} {
+    SectionWriter(SectionType type, std::uint32_t elementCount, std::vector<std::byte>& buffer)
+        : buffer{buffer}, sectionStart{buffer.size()} {
+        const SectionHeader sectionHeader{.type = type, .nextSectionOffset = 0, .elementCount = elementCount, .dataOffset = 0};
         write(sectionHeader.type);
         write(sectionHeader.nextSectionOffset);
         write(sectionHeader.elementCount);
@@ -27,31 +29,75 @@ public:
     template <typename T>
     requires std::is_trivially_copyable_v<T>
     void write(const T& value) {
-        stream.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        const auto offset = buffer.size();
+        buffer.resize(offset + sizeof(value));
+        std::memcpy(buffer.data() + offset, &value, sizeof(value));
     }
 
     ~SectionWriter() {
-        auto currentPos = stream.tellp();
-        stream.seekp(sectionStartPos + std::ios::off_type{1}, std::ios::beg);
-        write<std::uint32_t>(currentPos - sectionStartPos - 5);
-        stream.seekp(currentPos, std::ios::beg);
+        // counted from the end of the offset itself
+        const auto nextSectionOffset = static_cast<std::uint32_t>(buffer.size() - sectionStart - 5);
+        std::memcpy(buffer.data() + sectionStart + 1, &nextSectionOffset, sizeof(nextSectionOffset));
     }
 
 };
 
-void saveMap(std::span<const Vid> vids, const Map& map, std::ostream& stream) {
-    const std::uint32_t sectionCount = 5; // MapInfo, Objects, ObjectsIds, Command, Army
-    stream.write(reinterpret_cast<const char*>(&sectionCount), sizeof(sectionCount));
+namespace {
+    constexpr std::uint32_t sectionCount = 5; // MapInfo, Objects, ObjectsIds, Command, Army
+
+    // Exact size of the serialized map, so the buffer is allocated once
+    std::size_t serializedMapSize(std::span<const Vid> vids, const Map& map) {
+        constexpr std::size_t objectSize = sizeof(GameObject::nvid) + sizeof(GameObject::x) + sizeof(GameObject::y) + sizeof(GameObject::z)
+            + sizeof(GameObject::direction) + sizeof(GameObject::action);
+        constexpr std::size_t commandSize = sizeof(std::uint8_t) + sizeof(ObjectCommand::p1) + sizeof(ObjectCommand::p2);
+
+        std::size_t size = sizeof(sectionCount) + sectionCount * SectionHeader::size + sizeof(MapHeaderRawData);
+        for (const auto& obj : map.objects) {
+            size += objectSize + sizeof(obj.id);
+            switch(getObjectSerializationClass(vids[obj.nvid].behave)) {
+            case ObjectSerializationClass::Static:
+                size += sizeof(obj.payload.hp);
+                break;
+            case ObjectSerializationClass::Dynamic:
+                size += 4 + (obj.payload.items.size() + 1) * sizeof(std::int16_t);
+                break;
+            default:
+                break;
+            }
+
+            if (!obj.payload.commands.empty())
+                size += sizeof(obj.id) + sizeof(std::int32_t) + obj.payload.commands.size() * commandSize;
+        }
+        size += sizeof(std::uint16_t) + sizeof(std::uint32_t) + sizeof(std::uint32_t); // objects terminator, ids count, commands terminator
+
+        size += sizeof(std::uint8_t);
+        for (const auto& army : map.armies) {
+            size += sizeof(army.a) + sizeof(army.b) + sizeof(army.c) + sizeof(army.flagman_id) + sizeof(std::uint32_t);
+            for (const auto& squad : army.squads)
+                size += (squad.size() + 1) * sizeof(std::uint32_t);
+        }
+
+        return size;
+    }
+}
+
+std::vector<std::byte> serializeMap(std::span<const Vid> vids, const Map& map) {
+    const auto size = serializedMapSize(vids, map);
+    std::vector<std::byte> buffer;
+    buffer.reserve(size);
+
+    buffer.resize(sizeof(sectionCount));
+    std::memcpy(buffer.data(), &sectionCount, sizeof(sectionCount));
 
     {
-        SectionWriter writer{SectionType::MapInfo, 1, stream};
+        SectionWriter writer{SectionType::MapInfo, 1, buffer};
         MapHeaderRawData mapHeaderCopy {map.header};
         mapHeaderCopy.mapVersion = MapVersion::V3; // Ensure the map version is set to the latest
         writer.write(mapHeaderCopy);
     }
 
     {
-        SectionWriter writer{SectionType::Objects, 1, stream};
+        SectionWriter writer{SectionType::Objects, 1, buffer};
         for (const auto& obj : map.objects) {
             writer.write(obj.nvid);
             writer.write(obj.x);
@@ -80,7 +126,7 @@ void saveMap(std::span<const Vid> vids, const Map& map, std::ostream& stream) {
     }
 
     {
-        SectionWriter writer{SectionType::ObjectsIds, 1, stream};
+        SectionWriter writer{SectionType::ObjectsIds, 1, buffer};
         writer.write(static_cast<std::uint32_t>(map.objects.size()));
         for (const auto& obj : map.objects) {
             writer.write(obj.id);
@@ -88,7 +134,7 @@ void saveMap(std::span<const Vid> vids, const Map& map, std::ostream& stream) {
     }
 
     {
-        SectionWriter writer{SectionType::Command, 1, stream};
+        SectionWriter writer{SectionType::Command, 1, buffer};
 
         auto objects = map.objects | std::views::filter([](const GameObject& obj) { return !obj.payload.commands.empty(); });
         for (const auto& obj : objects) {
@@ -105,7 +151,7 @@ void saveMap(std::span<const Vid> vids, const Map& map, std::ostream& stream) {
     }
 
     {
-        SectionWriter writer{SectionType::Army, 1, stream};
+        SectionWriter writer{SectionType::Army, 1, buffer};
         writer.write<std::uint8_t>(2); // Number of armies
         for (const auto& army : map.armies) {
             writer.write(army.a);
@@ -122,4 +168,31 @@ void saveMap(std::span<const Vid> vids, const Map& map, std::ostream& stream) {
         }
     }
 
-}
\ No newline at end of file
+    assert(buffer.size() == size && "serializedMapSize is out of sync with the format");
+    return buffer;
+}
+
+void saveMap(std::span<const Vid> vids, const Map& map, std::ostream& stream) {
+    const auto buffer = serializeMap(vids, map);
+    stream.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+}
+
+void saveMap(std::span<const Vid> vids, const Map& map, const std::filesystem::path& path) {
+    const auto buffer = serializeMap(vids, map);
+
+    auto temporaryPath = path;
+    temporaryPath += ".tmp";
+    try {
+        std::ofstream stream{temporaryPath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc};
+        stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        stream.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        stream.close();
+
+        std::filesystem::rename(temporaryPath, path);
+    }
+    catch (...) {
+        std::error_code error;
+        std::filesystem::remove(temporaryPath, error);
+        throw;
+    }
+}
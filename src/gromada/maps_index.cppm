@@ -0,0 +1,271 @@
+export module Gromada.MapsIndex;
+
+import std;
+import nlohmann.json;
+import png_writer;
+import thread_pool;
+
+import Gromada.GameResources;
+import Gromada.Map;
+import Gromada.MapRenderer;
+
+export struct MapSummary {
+	std::filesystem::path path;
+	std::u8string name; // path relative to the maps directory
+	std::uintmax_t fileSize = 0;
+	std::int64_t modificationTime = 0; // in ticks of the filesystem clock
+
+	MapHeaderRawData header;
+	std::size_t numObjects = 0;
+	std::size_t numCommands = 0;
+	std::filesystem::path thumbnail; // PNG file, empty if the map couldn't be rendered
+	std::string error;
+
+	// Otherwise it's only found in the directory yet
+	[[nodiscard]] bool isSummarized() const noexcept { return !thumbnail.empty() || !error.empty(); }
+};
+
+// Summaries of the maps of a directory (headers, object counts and thumbnails), so the maps can be browsed without loading them.
+// Maps are summarized by the worker threads in the background. The index is kept between the launches in the index directory
+// (index.json and the thumbnails), and only the maps whose size or modification time has changed are summarized again.
+export class MapsIndex {
+public:
+	static constexpr int thumbnailSize = 128; // of the longer side, in pixels
+
+	MapsIndex(const GameResources& resources, std::filesystem::path mapsDirectory, std::filesystem::path indexDirectory,
+		std::size_t numThreads = std::min<std::size_t>(ThreadPool::defaultThreadCount(), 2));
+	MapsIndex(const MapsIndex&) = delete;
+	MapsIndex& operator=(const MapsIndex&) = delete;
+	~MapsIndex();
+
+	// Scans the maps directory again, new and changed maps are queued
+	void refresh();
+	// Collects the finished summaries and starts the next ones, returns true if some summaries have changed.
+	// The index is saved once all the maps are summarized
+	bool update();
+
+	[[nodiscard]] std::span<const MapSummary> maps() const noexcept { return m_maps; } // sorted by name
+	[[nodiscard]] std::size_t numPending() const noexcept { return m_queue.size() + m_running.size(); }
+
+private:
+	struct Job {
+		std::u8string name;
+		std::future<MapSummary> result;
+	};
+
+	void load();
+	void save() const;
+
+	const GameResources& m_resources;
+	std::filesystem::path m_mapsDirectory;
+	std::filesystem::path m_indexDirectory;
+
+	std::vector<MapSummary> m_maps;
+	std::deque<std::u8string> m_queue; // names of the maps to summarize
+	std::vector<Job> m_running;
+	bool m_dirty = false; // there are summaries which aren't saved yet
+
+	ThreadPool m_pool;
+};
+
+
+// Implementation
+namespace {
+	constexpr int indexVersion = 1;
+
+	std::string toString(const std::u8string& string) { return {reinterpret_cast<const char*>(string.data()), string.size()}; }
+	std::u8string toU8String(const std::string& string) { return {reinterpret_cast<const char8_t*>(string.data()), string.size()}; }
+
+	MapSummary summarizeMap(const GameResources& resources, MapSummary summary, const std::filesystem::path& thumbnailPath, ThreadPool& pool) {
+		try {
+			const auto map = loadMap(resources.vids(), summary.path);
+			summary.header = map.header;
+			summary.numObjects = map.objects.size();
+			summary.numCommands = std::ranges::fold_left(
+				map.objects | std::views::transform([](const GameObject& object) { return object.payload.commands.size(); }), std::size_t{0}, std::plus{});
+
+			const auto longerSide = static_cast<int>(std::max(map.header.width, map.header.height));
+			const auto image = renderMap(resources, map, std::max(1, (longerSide + MapsIndex::thumbnailSize - 1) / MapsIndex::thumbnailSize), pool);
+			std::filesystem::create_directories(thumbnailPath.parent_path());
+			savePng(thumbnailPath, image.width(), image.height(), std::as_bytes(image.pixels()));
+			summary.thumbnail = thumbnailPath;
+		}
+		catch (const std::exception& e) {
+			summary.error = e.what();
+		}
+
+		return summary;
+	}
+}
+
+MapsIndex::MapsIndex(const GameResources& resources, std::filesystem::path mapsDirectory, std::filesystem::path indexDirectory, std::size_t numThreads)
+	: m_resources{resources}
+	, m_mapsDirectory{std::move(mapsDirectory)}
+	, m_indexDirectory{std::move(indexDirectory)}
+	, m_pool{numThreads} {
+	load();
+	refresh();
+}
+
+MapsIndex::~MapsIndex() {
+	m_queue.clear();
+	for (auto& job : m_running)
+		job.result.wait();
+
+	// Saves what is summarized by now
+	update();
+}
+
+void MapsIndex::refresh() {
+	std::vector<MapSummary> maps;
+	if (std::filesystem::exists(m_mapsDirectory)) {
+		for (const auto& entry : std::filesystem::recursive_directory_iterator{m_mapsDirectory}) {
+			if (!entry.is_regular_file() || entry.path().extension() != ".map")
+				continue;
+
+			MapSummary summary {
+				.path = entry.path(),
+				.name = std::filesystem::relative(entry.path(), m_mapsDirectory).u8string(),
+				.fileSize = entry.file_size(),
+				.modificationTime = entry.last_write_time().time_since_epoch().count(),
+			};
+
+			// Not summarized ones are in the queue already, and the summary is redone if its thumbnail is deleted
+			const auto known = std::ranges::find(m_maps, summary.name, &MapSummary::name);
+			const bool isUpToDate = known != m_maps.end() && known->fileSize == summary.fileSize && known->modificationTime == summary.modificationTime
+				&& (!known->isSummarized() || known->thumbnail.empty() || std::filesystem::exists(known->thumbnail));
+			if (isUpToDate) {
+				maps.push_back(*known);
+				continue;
+			}
+
+			if (std::ranges::find(m_queue, summary.name) == m_queue.end())
+				m_queue.push_back(summary.name);
+			maps.push_back(std::move(summary));
+		}
+	}
+
+	std::ranges::sort(maps, {}, &MapSummary::name);
+	m_dirty |= maps.size() != m_maps.size();
+	m_maps = std::move(maps);
+}
+
+bool MapsIndex::update() {
+	bool changed = false;
+	std::erase_if(m_running, [&](Job& job) {
+		if (job.result.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+			return false;
+
+		// Map could be gone from the directory while it was summarized
+		auto summary = job.result.get();
+		if (const auto it = std::ranges::find(m_maps, summary.name, &MapSummary::name); it != m_maps.end() && it->modificationTime == summary.modificationTime) {
+			*it = std::move(summary);
+			changed = true;
+		}
+		return true;
+	});
+
+	// A map per frame without the workers, so the editor stays responsive
+	const auto maxRunning = std::max<std::size_t>(m_pool.size(), 1);
+	while (!m_queue.empty() && m_running.size() < maxRunning) {
+		auto name = std::move(m_queue.front());
+		m_queue.pop_front();
+
+		const auto it = std::ranges::find(m_maps, name, &MapSummary::name);
+		if (it == m_maps.end())
+			continue;
+
+		const auto thumbnailPath = (m_indexDirectory / it->name).replace_extension(".png");
+		auto result = m_pool.submit([&resources = m_resources, &pool = m_pool, summary = *it, thumbnailPath] {
+			return summarizeMap(resources, summary, thumbnailPath, pool);
+		});
+		m_running.push_back({std::move(name), std::move(result)});
+	}
+
+	m_dirty |= changed;
+	if (m_dirty && numPending() == 0) {
+		m_dirty = false;
+		try {
+			save();
+		}
+		catch (const std::exception& e) {
+			// The index is just an optimization, the maps will be summarized again
+			std::cerr << "Failed to save maps index " << m_indexDirectory.generic_string() << ": " << e.what() << std::endl;
+		}
+	}
+
+	return changed;
+}
+
+void MapsIndex::load() {
+	const auto indexPath = m_indexDirectory / "index.json";
+	if (!std::filesystem::exists(indexPath))
+		return;
+
+	try {
+		const auto index = nlohmann::json::parse(std::ifstream{indexPath});
+		if (index.at("version").get<int>() != indexVersion)
+			return;
+
+		for (const auto& entry : index.at("maps")) {
+			const auto& header = entry.at("header");
+			auto& summary = m_maps.emplace_back(MapSummary{
+				.name = toU8String(entry.at("name").get<std::string>()),
+				.fileSize = entry.at("size").get<std::uintmax_t>(),
+				.modificationTime = entry.at("modificationTime").get<std::int64_t>(),
+				.header = {
+					.width = header.at("width").get<std::uint32_t>(),
+					.height = header.at("height").get<std::uint32_t>(),
+					.observerX = header.at("observerX").get<std::int16_t>(),
+					.observerY = header.at("observerY").get<std::int16_t>(),
+					.scaleX = header.at("scaleX").get<std::uint32_t>(),
+					.scaleY = header.at("scaleY").get<std::uint32_t>(),
+					.startTimer = header.at("startTimer").get<std::uint32_t>(),
+					.mapVersion = static_cast<MapVersion>(header.at("mapVersion").get<std::uint32_t>()),
+				},
+				.numObjects = entry.at("objects").get<std::size_t>(),
+				.numCommands = entry.at("commands").get<std::size_t>(),
+				.error = entry.at("error").get<std::string>(),
+			});
+			summary.path = m_mapsDirectory / summary.name;
+			if (const auto thumbnail = entry.at("thumbnail").get<std::string>(); !thumbnail.empty())
+				summary.thumbnail = m_indexDirectory / toU8String(thumbnail);
+		}
+	}
+	catch (const std::exception& e) {
+		// Everything is summarized again
+		std::cerr << "Failed to load maps index " << indexPath.generic_string() << ": " << e.what() << std::endl;
+		m_maps.clear();
+	}
+}
+
+void MapsIndex::save() const {
+	auto maps = nlohmann::json::array();
+	for (const auto& summary : m_maps | std::views::filter(&MapSummary::isSummarized)) {
+		const auto& header = summary.header;
+		maps.push_back({
+			{"name", toString(summary.name)},
+			{"size", summary.fileSize},
+			{"modificationTime", summary.modificationTime},
+			{"header", {
+				{"width", header.width},
+				{"height", header.height},
+				{"observerX", header.observerX},
+				{"observerY", header.observerY},
+				{"scaleX", header.scaleX},
+				{"scaleY", header.scaleY},
+				{"startTimer", header.startTimer},
+				{"mapVersion", std::to_underlying(header.mapVersion)},
+			}},
+			{"objects", summary.numObjects},
+			{"commands", summary.numCommands},
+			{"thumbnail", summary.thumbnail.empty() ? std::string{} : toString(std::filesystem::relative(summary.thumbnail, m_indexDirectory).generic_u8string())},
+			{"error", summary.error},
+		});
+	}
+
+	std::filesystem::create_directories(m_indexDirectory);
+	std::ofstream stream{m_indexDirectory / "index.json", std::ios_base::out | std::ios_base::trunc};
+	stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+	stream << nlohmann::json{{"version", indexVersion}, {"maps", std::move(maps)}}.dump(1, '\t');
+}
@@ -3,13 +3,18 @@ module;
 export module Gromada.ResourceReader;
 import std;
 import utils;
+import thread_pool;
+export import mapped_file;
 
 export {
 
 	class BinaryStreamReader : public StreamReaderMixin<BinaryStreamReader> {
 	public:
-		explicit BinaryStreamReader(std::istream& stream, std::size_t length) : m_stream{ stream }, m_dataLength{ length } {}
-		explicit BinaryStreamReader(std::istream& stream) : m_stream{ stream }, m_dataLength{ std::numeric_limits<std::size_t>::max() } {}
+		explicit BinaryStreamReader(std::istream& stream, std::size_t length) : m_stream{ &stream }, m_dataLength{ length } {}
+		explicit BinaryStreamReader(std::istream& stream) : m_stream{ &stream }, m_dataLength{ std::numeric_limits<std::size_t>::max() } {}
+		// Reads directly from memory (e.g. a memory-mapped file); beginPos is the position of the data in the whole file
+		explicit BinaryStreamReader(std::span<const std::byte> data, std::streampos beginPos)
+			: m_memory{ data.data() }, m_memoryBeginPos{ beginPos }, m_dataLength{ data.size() } {}
 
 		using StreamReaderMixin::read_to;
 
@@ -17,26 +22,47 @@ export {
 			if (m_count + out.size() > m_dataLength)
 				throw std::overflow_error("out of section access");
 
-			m_stream.read(reinterpret_cast<char*>(out.data()), out.size());
+			if (m_memory) {
+				std::memcpy(out.data(), m_memory + m_count, out.size());
+			} else {
+				m_stream->read(reinterpret_cast<char*>(out.data()), out.size());
+			}
 
 			m_count += out.size();
 		}
 
+		// Zero-copy access, available only for the memory-backed readers
+		[[nodiscard]] std::span<const std::byte> read_bytes(std::size_t size) {
+			if (!m_memory)
+				throw std::logic_error("BinaryStreamReader: read_bytes requires a memory-backed reader");
+
+			if (size > bytesRemaining())
+				throw std::overflow_error("out of section access");
+
+			return std::span{m_memory + std::exchange(m_count, m_count + size), size};
+		}
+
 		void skip(std::size_t bytes) { 
 			if (m_count + bytes > m_dataLength)
 				throw std::overflow_error("");
 
-			m_stream.seekg(bytes, std::ios_base::cur); 
+			if (!m_memory)
+				m_stream->seekg(bytes, std::ios_base::cur); 
 			m_count += bytes;
 		}
 
+		[[nodiscard]] bool isMemoryBacked() const noexcept { return m_memory != nullptr; }
 		[[nodiscard]] std::size_t size() const noexcept { return m_dataLength; }
 		[[nodiscard]] std::size_t bytesRemaining() const noexcept { return m_dataLength - m_count; }
-		[[nodiscard]] std::streampos tellg() const noexcept { return m_stream.tellg(); }
+		[[nodiscard]] std::streampos tellg() const noexcept {
+			return m_memory ? m_memoryBeginPos + static_cast<std::streamoff>(m_count) : m_stream->tellg();
+		}
 		//std::istream& stream() const&& noexcept { return m_stream; }
 
 	private:
-		std::istream& m_stream;
+		std::istream* m_stream = nullptr;
+		const std::byte* m_memory = nullptr;
+		std::streampos m_memoryBeginPos;
 		std::size_t m_dataLength;
 		std::size_t m_count = 0;
 	};
@@ -63,15 +89,9 @@ export {
 		std::uint32_t elementCount;
 		std::uint16_t dataOffset;
 
-		static SectionHeader read(std::istream& stream) {
-			SectionHeader sectionHeader;
-			stream.read(reinterpret_cast<char*>(&sectionHeader.type), 1);
-			stream.read(reinterpret_cast<char*>(&sectionHeader.nextSectionOffset), 4);
-			stream.read(reinterpret_cast<char*>(&sectionHeader.elementCount), 4);
-			stream.read(reinterpret_cast<char*>(&sectionHeader.dataOffset), 2);
+		static constexpr std::size_t size = 11;
 
-			return sectionHeader;
-		}
+		static SectionHeader read(BinaryStreamReader& reader);
 	};
 
 	class StreamSpan {
@@ -86,6 +106,23 @@ export {
 			return BinaryStreamReader{stream, static_cast<std::size_t>(m_endPos - m_beginPos)};
 		}
 
+		[[nodiscard]] std::streampos beginPos() const noexcept { return m_beginPos; }
+		[[nodiscard]] std::streampos endPos() const noexcept { return m_endPos; }
+
+		// View of the span inside of the whole file's data, without any copying
+		[[nodiscard]] std::span<const std::byte> view(std::span<const std::byte> fileData) const {
+			const auto begin = static_cast<std::streamoff>(m_beginPos);
+			const auto end = static_cast<std::streamoff>(m_endPos);
+			if (begin < 0 || end < begin || static_cast<std::size_t>(end) > fileData.size())
+				throw std::overflow_error("out of file access");
+
+			return fileData.subspan(static_cast<std::size_t>(begin), static_cast<std::size_t>(end - begin));
+		}
+
+		BinaryStreamReader beginRead(std::span<const std::byte> fileData) const {
+			return BinaryStreamReader{view(fileData), m_beginPos};
+		}
+
 	private:
 		std::streampos m_beginPos, m_endPos;
 	};
@@ -93,7 +130,7 @@ export {
 	class Section : public StreamSpan {
 	public:
 		Section(const SectionHeader& header, std::streampos beginPos) 
-			: StreamSpan{beginPos + static_cast<std::streampos>(11 + header.dataOffset), beginPos + static_cast<std::streamoff>(5 + header.nextSectionOffset)}
+			: StreamSpan{beginPos + static_cast<std::streamoff>(SectionHeader::size + header.dataOffset), beginPos + static_cast<std::streamoff>(5 + header.nextSectionOffset)}
 			, m_header{ header }
 			, m_beginPos{ beginPos } {}
 
@@ -111,12 +148,22 @@ export {
 
 	class GromadaResourceReader {
 	public:
-		explicit GromadaResourceReader(const std::filesystem::path& path) try
-		: m_stream{ path, std::ios_base::in | std::ios_base::binary } {
-			m_stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+		enum class ReadMode {
+			Stream,
+			// Whole file is memory-mapped, readers and sections refer directly to the mapping
+			Mapped,
+		};
+
+		explicit GromadaResourceReader(const std::filesystem::path& path, ReadMode mode = ReadMode::Stream) try {
+			if (mode == ReadMode::Mapped) {
+				m_mapping = std::make_shared<const MappedFile>(path);
+			} else {
+				m_stream.open(path, std::ios_base::in | std::ios_base::binary);
+				m_stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+			}
 
-			m_stream.read(reinterpret_cast<char*>(&m_sectionsCount), sizeof(std::uint32_t));
-			m_currentSectionBegin = m_stream.tellg();
+			m_sectionsCount = beginRead(StreamSpan{std::streampos{0}, std::streamoff{sizeof(std::uint32_t)}}).read<std::uint32_t>();
+			m_currentSectionBegin = sizeof(std::uint32_t);
 
 		    if (m_sectionsCount > 10000)
 		        throw std::runtime_error("GromadaResourceReader: too many sections in resource file");
@@ -124,18 +171,25 @@ export {
 			std::throw_with_nested(GromadaResourceException{std::format("Failed to read resource file {}", path.generic_string())});
 		}
 
+		// Reads from the data in memory, it should outlive the reader
+		explicit GromadaResourceReader(std::span<const std::byte> data) try : m_memory{data}, m_isMemoryBacked{true} {
+			m_sectionsCount = beginRead(StreamSpan{std::streampos{0}, std::streamoff{sizeof(std::uint32_t)}}).read<std::uint32_t>();
+			m_currentSectionBegin = sizeof(std::uint32_t);
+
+		    if (m_sectionsCount > 10000)
+		        throw std::runtime_error("GromadaResourceReader: too many sections in resource data");
+		} catch ( ... ) {
+			std::throw_with_nested(GromadaResourceException{std::format("Failed to read resource data of {} bytes", data.size())});
+		}
+
 		void goStart() {
-			m_stream.seekg(4, std::ios_base::beg);
-			m_currentSectionBegin = m_stream.tellg();
+			m_currentSectionBegin = sizeof(std::uint32_t);
 			m_currentSectionIndex = 0;
 		}
 
 		std::optional<Section> nextSection() {
-			m_stream.seekg(m_currentSectionBegin, std::ios_base::beg);
-			auto currentSection = SectionHeader::read(m_stream);
-
-			// skip unused bytes
-			m_stream.seekg(currentSection.dataOffset, std::ios_base::cur);
+			auto headerReader = beginRead(StreamSpan{m_currentSectionBegin, static_cast<std::streamoff>(SectionHeader::size)});
+			auto currentSection = SectionHeader::read(headerReader);
 
 			if (m_currentSectionIndex++ == m_sectionsCount || currentSection.nextSectionOffset == 0) {
 				return std::nullopt;
@@ -149,6 +203,11 @@ export {
 		}
 
 		BinaryStreamReader beginRead(const StreamSpan& section) {
+			if (m_mapping)
+				return section.beginRead(m_mapping->bytes());
+			if (m_isMemoryBacked)
+				return section.beginRead(m_memory);
+
 			return section.beginRead(m_stream);
 		}
 
@@ -159,9 +218,14 @@ export {
 		//}
 
 		[[nodiscard]] std::uint32_t getNumSections() const noexcept { return m_sectionsCount;  }
+		// Empty for the stream mode. Data of the memory-backed readers is valid only while the mapping is alive
+		[[nodiscard]] const std::shared_ptr<const MappedFile>& mapping() const noexcept { return m_mapping; }
 
 	private:
 		std::ifstream m_stream;
+		std::shared_ptr<const MappedFile> m_mapping;
+		std::span<const std::byte> m_memory;
+		bool m_isMemoryBacked = false; // by m_memory
 		std::uint32_t m_sectionsCount = 0;
 		std::uint32_t m_currentSectionIndex = 0;
 
@@ -186,6 +250,9 @@ export {
 		}
 
 		[[nodiscard]] std::span<const Section> getSections() const noexcept { return m_sections; }
+		[[nodiscard]] const std::shared_ptr<const MappedFile>& mapping() const noexcept { return m_reader.mapping(); }
+		// The section should be one of getSections()
+		BinaryStreamReader beginRead(const Section& section) { return m_reader.beginRead(section); }
 
 	    std::size_t visitSectionsOfType (SectionType sectionType, std::invocable<const Section&, BinaryStreamReader> auto&& visitor) {
 		    std::size_t sectionCount = 0;
@@ -199,9 +266,39 @@ export {
 		    return sectionCount;
 		};
 
+		// Every section gets an independent reader, so visitors of the memory-mapped file run concurrently
+		// (stream-backed readers share the same stream, so they're visited sequentially).
+		// The visitor gets an index of the section in the given list, the first failed section's exception is rethrown.
+		void visitSectionsInParallel(ThreadPool& pool, std::span<const Section* const> sections, std::invocable<std::size_t, const Section&, BinaryStreamReader> auto&& visitor) {
+			if (!m_reader.mapping()) {
+				for (std::size_t i = 0; i < sections.size(); ++i)
+					visitor(i, *sections[i], m_reader.beginRead(*sections[i]));
+				return;
+			}
+
+			const auto fileData = m_reader.mapping()->bytes();
+			pool.parallelFor(sections.size(), [&](std::size_t i) {
+				visitor(i, *sections[i], sections[i]->beginRead(fileData));
+			});
+		}
+
 	private:
 	    GromadaResourceReader m_reader;
 		std::vector<Section> m_sections;
 	};
 
 }
+
+
+// Implementation
+using SectionHeaderLayout = PackedLayout<SectionHeader,
+	&SectionHeader::type,
+	&SectionHeader::nextSectionOffset,
+	&SectionHeader::elementCount,
+	&SectionHeader::dataOffset
+>;
+static_assert(SectionHeaderLayout::size == SectionHeader::size);
+
+SectionHeader SectionHeader::read(BinaryStreamReader& reader) {
+	return reader.read_packed<SectionHeaderLayout>();
+}
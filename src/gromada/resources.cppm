@@ -5,6 +5,7 @@ export module Gromada.Resources;
 
 export import Gromada.Actions;
 import Gromada.ResourceReader;
+import Gromada.GraphicsFormat;
 import std;
 import utils;
 import cp866;
@@ -89,10 +90,7 @@ export std::string to_string(ObjectFlags flags) {
     return result;
 }
 
-export struct VidGraphics {
-    VidGraphics() = default;
-    explicit VidGraphics(BinaryStreamReader& reader);
-
+export struct VidGraphicsHeader {
 	std::uint8_t dataFormat;
 	std::uint16_t frameDuration;
 	std::uint16_t numOfFrames;
@@ -100,24 +98,99 @@ export struct VidGraphics {
 	std::uint16_t width;
 	std::uint16_t height;
 
+	static VidGraphicsHeader read(BinaryStreamReader& reader);
+};
+
+export struct VidGraphics : VidGraphicsHeader {
+    VidGraphics() = default;
+    explicit VidGraphics(BinaryStreamReader& reader);
+    VidGraphics(const VidGraphicsHeader& header, BinaryStreamReader& reader);
+
+	// Location of a frame's data, relative to the beginning of the pixel data
+	struct FrameLocation {
+		std::uint32_t offset;
+		std::uint32_t size;
+	};
+	// Restores graphics with already known frames layout, without parsing; payload is the same data the reader would provide
+	VidGraphics(const VidGraphicsHeader& header, std::span<const std::byte> payload, std::span<const FrameLocation> frameLocations);
+	// Reads only the frames table of the payload, nothing is decoded or indexed
+	static std::vector<FrameLocation> locateFrames(const VidGraphicsHeader& header, std::span<const std::byte> payload);
+
 	std::array<ColorRgb8, 256> palette;
-	std::vector<std::byte> data;
+	// Points either to ownedData or directly to the memory-mapped resource file (see GromadaResourceReader::ReadMode)
+	std::span<const std::byte> data;
+	std::vector<std::byte> ownedData;
 
 	struct Frame {
 		std::span<const std::byte> data;
 	    const VidGraphics* parent;
+	    // Offsets of the rows in data, only for the row-compressed formats (see indexFrameRows)
+	    std::span<const std::uint32_t> rowOffsets;
 
 	    SpanStreamReader read() const noexcept {return data; }
 	    [[nodiscard]] int width() const noexcept { return parent->width; }
 	    [[nodiscard]] int height() const noexcept { return parent->height; }
 	};
 	std::vector<Frame> frames;
+	std::vector<std::uint32_t> rowOffsets; // of all the frames
+
+	[[nodiscard]] FrameLocation frameLocation(const Frame& frame) const noexcept {
+		return {static_cast<std::uint32_t>(frame.data.data() - data.data()), static_cast<std::uint32_t>(frame.data.size())};
+	}
+
+private:
+	void buildRowsIndex();
 };
 
-export struct Vid {
-    Vid() = default;
-    explicit Vid (BinaryStreamReader reader);
+// Keeps the cheap header and decodes the rest of graphics on the first access, thread-safe
+export class LazyVidGraphics {
+public:
+    using Loader = std::function<std::shared_ptr<const VidGraphics>()>;
+
+    // Where the graphics are in the memory-mapped resource file, known without decoding them
+    struct Layout {
+        std::span<const std::byte> payload; // palette and pixel data
+        std::vector<VidGraphics::FrameLocation> frameLocations;
+    };
+
+    explicit LazyVidGraphics(std::shared_ptr<const VidGraphics> graphics) : m_header{*graphics}, m_graphics{std::move(graphics)} {}
+    LazyVidGraphics(const VidGraphicsHeader& header, Loader loader) : m_header{header}, m_loader{std::move(loader)} {}
+    // Decodes the graphics from the layout on the first access
+    LazyVidGraphics(const VidGraphicsHeader& header, std::shared_ptr<const Layout> layout)
+        : m_header{header}
+        , m_loader{[header, layout] { return std::make_shared<const VidGraphics>(header, layout->payload, layout->frameLocations); }}
+        , m_layout{std::move(layout)} {}
+
+    [[nodiscard]] const VidGraphicsHeader& header() const noexcept { return m_header; }
+    // Only for the graphics created from a layout
+    [[nodiscard]] const Layout* layout() const noexcept { return m_layout.get(); }
+    [[nodiscard]] const VidGraphics& get() const {
+        std::call_once(m_loadFlag, [this] {
+            if (!m_graphics) {
+                m_graphics = m_loader();
+                m_loader = nullptr;
+            }
+        });
+
+        return *m_graphics;
+    }
+
+private:
+    VidGraphicsHeader m_header;
+    mutable std::once_flag m_loadFlag;
+    mutable Loader m_loader;
+    mutable std::shared_ptr<const VidGraphics> m_graphics;
+    std::shared_ptr<const Layout> m_layout;
+};
 
+export enum class GraphicsLoading {
+    Eager,
+    // Requires a memory-backed reader, falls back to the eager loading otherwise
+    Lazy,
+};
+
+// Plain part of the Vid, trivially copyable to be stored as is (see Gromada.ResourcesCache)
+export struct VidProperties {
 	std::array<char, 34> name {0}; // In CP-866
 	UnitType unitType {};
 	std::uint8_t behave {};
@@ -158,13 +231,79 @@ export struct Vid {
 	std::array<std::uint8_t, 16> childrenCount {};
 
 	std::int32_t dataSizeOrNvid {}; // if < 0 then it's nvid
+};
 
-	using Graphics = std::shared_ptr<VidGraphics>;
+// Layouts of the packed records, in the same order as the fields are stored in the file
+export using VidPropertiesLayout = PackedLayout<VidProperties,
+	&VidProperties::name,
+	&VidProperties::unitType,
+	&VidProperties::behave,
+	&VidProperties::flags,
+	&VidProperties::collisionMask,
+	&VidProperties::sizeX,
+	&VidProperties::sizeY,
+	&VidProperties::sizeZ,
+	&VidProperties::maxHP,
+	&VidProperties::visibilityRadius,
+	&VidProperties::unused1,
+	&VidProperties::speedX,
+	&VidProperties::speedY,
+	&VidProperties::acceleration,
+	&VidProperties::rotationPeriod,
+	&VidProperties::army,
+	&VidProperties::someWeaponIndex,
+	&VidProperties::unused2,
+	&VidProperties::deathDamageRadius,
+	&VidProperties::deathDamage,
+	&VidProperties::linkX,
+	&VidProperties::linkY,
+	&VidProperties::linkZ,
+	&VidProperties::linkedObjectVid,
+	&VidProperties::unused3,
+	&VidProperties::directionsCount,
+	&VidProperties::z_layer,
+	&VidProperties::animationLengths,
+	&VidProperties::nsfx,
+	&VidProperties::childrenOffsets,
+	&VidProperties::childNvid,
+	&VidProperties::childrenCount,
+	&VidProperties::dataSizeOrNvid
+>;
+static_assert(VidPropertiesLayout::size == 267, "Unexpected size of the Vid header");
+
+export using VidGraphicsHeaderLayout = PackedLayout<VidGraphicsHeader,
+	&VidGraphicsHeader::dataFormat,
+	&VidGraphicsHeader::frameDuration,
+	&VidGraphicsHeader::numOfFrames,
+	&VidGraphicsHeader::dataSize,
+	&VidGraphicsHeader::width,
+	&VidGraphicsHeader::height
+>;
+static_assert(VidGraphicsHeaderLayout::size == 13, "Unexpected size of the graphics header");
+
+export struct Vid : VidProperties {
+    Vid() = default;
+    explicit Vid (BinaryStreamReader reader, GraphicsLoading graphicsLoading = GraphicsLoading::Eager);
+
+	// NOTE: lazily loaded graphics refer to the resource file, so they are bound to the GameResources lifetime
+	using Graphics = std::shared_ptr<const LazyVidGraphics>;
 	std::variant<std::int32_t, Graphics> graphicsData;
 
+	Vid(const VidProperties& properties, std::variant<std::int32_t, Graphics> graphicsData)
+		: VidProperties{properties}, graphicsData{std::move(graphicsData)} {}
+
 	//
 	[[nodiscard]] std::string getName() const { return cp866_to_utf8(std::string_view{name.data()}); }
+    // Doesn't trigger decoding of the lazily loaded graphics
+    const VidGraphicsHeader& graphicsHeader() const {
+        return lazyGraphics().header();
+    }
     const VidGraphics& graphics() const {
+        return lazyGraphics().get();
+    }
+
+private:
+    const LazyVidGraphics& lazyGraphics() const {
         const auto* graphics = std::get_if<Vid::Graphics>(&graphicsData);
         if (!graphics || !graphics->get())
             throw std::logic_error("Missing graphics");
@@ -184,69 +323,45 @@ export struct AdjacencyData {
 export AdjacencyData getAdjacencyData(const Section& section, BinaryStreamReader reader);
 
 // Implementation
-Vid::Vid(BinaryStreamReader reader)
+Vid::Vid(BinaryStreamReader reader, GraphicsLoading graphicsLoading)
 {
-	reader.read_to(name);
-	reader.read_to(unitType);
-	reader.read_to(behave);
-	reader.read_to(flags);
-
-	reader.read_to(collisionMask);
-	reader.read_to(sizeX);
-	reader.read_to(sizeY);
-	reader.read_to(sizeZ);
-	reader.read_to(maxHP);
-	reader.read_to(visibilityRadius);
-	reader.read_to(unused1);
-
-	reader.read_to(speedX);
-	reader.read_to(speedY);
-	reader.read_to(acceleration);
-	reader.read_to(rotationPeriod);
-
-	reader.read_to(army);
-	reader.read_to(someWeaponIndex);
-	reader.read_to(unused2);
-	reader.read_to(deathDamageRadius);
-	reader.read_to(deathDamage);
-
-	reader.read_to(linkX);
-	reader.read_to(linkY);
-	reader.read_to(linkZ);
-	reader.read_to(linkedObjectVid);
-
-	reader.read_to(unused3);
-	reader.read_to(directionsCount);
-	reader.read_to(z_layer);
-
-	reader.read_to(animationLengths);
-	reader.read_to(nsfx);
-	reader.read_to(childrenOffsets);
-	reader.read_to(childNvid);
-	reader.read_to(childrenCount);
-
-	reader.read_to(dataSizeOrNvid);
+	reader.read_packed<VidPropertiesLayout>(*this);
 
 	if (dataSizeOrNvid < 0) {
 		graphicsData = std::int32_t{-dataSizeOrNvid};
+	} else if (graphicsLoading == GraphicsLoading::Lazy && reader.isMemoryBacked()) {
+		// Frames table is cheap to walk now, and the resources cache is written from it without decoding anything
+		const auto header = VidGraphicsHeader::read(reader);
+		const auto payload = reader.read_bytes(header.dataSize);
+		graphicsData = std::make_shared<const LazyVidGraphics>(header, std::make_shared<const LazyVidGraphics::Layout>(LazyVidGraphics::Layout{payload, VidGraphics::locateFrames(header, payload)}));
 	} else {
-		graphicsData = std::make_shared<VidGraphics>(reader);
+		graphicsData = std::make_shared<const LazyVidGraphics>(std::make_shared<const VidGraphics>(reader));
 	}
 }
 
-VidGraphics::VidGraphics(BinaryStreamReader& reader) {
-	reader.read_to(dataFormat);
-	reader.read_to(frameDuration);
-	reader.read_to(numOfFrames);
-	reader.read_to(dataSize);
-	reader.read_to(width);
-	reader.read_to(height);
+VidGraphicsHeader VidGraphicsHeader::read(BinaryStreamReader& reader) {
+	return reader.read_packed<VidGraphicsHeaderLayout>();
+}
 
-	data.resize(dataSize - sizeof(palette));
+VidGraphics::VidGraphics(BinaryStreamReader& reader)
+	: VidGraphics{VidGraphicsHeader::read(reader), reader} {}
+
+VidGraphics::VidGraphics(const VidGraphicsHeader& header, BinaryStreamReader& reader)
+	: VidGraphicsHeader{header} {
+	if (dataSize < sizeof(palette))
+		throw std::runtime_error("VidGraphics: data size is less than the palette size");
+
+	const std::size_t pixelDataSize = dataSize - sizeof(palette);
 	reader.read_to(palette);
-	
+
 	frames.resize(numOfFrames);
-	reader.read_to(std::span{ data });
+	if (reader.isMemoryBacked()) {
+		data = reader.read_bytes(pixelDataSize);
+	} else {
+		ownedData.resize(pixelDataSize);
+		reader.read_to(std::span{ ownedData });
+		data = ownedData;
+	}
 
 	SpanStreamReader frameDataReader{data};
 	for (std::size_t i = 0; i < frames.size(); ++i) {
@@ -262,6 +377,69 @@ VidGraphics::VidGraphics(BinaryStreamReader& reader) {
 	        frames[i] = frames.at(referenceFrameNumber);
 	    }
 	}
+
+	buildRowsIndex();
+}
+
+VidGraphics::VidGraphics(const VidGraphicsHeader& header, std::span<const std::byte> payload, std::span<const FrameLocation> frameLocations)
+	: VidGraphicsHeader{header} {
+	if (dataSize < sizeof(palette) || payload.size() != dataSize || frameLocations.size() != numOfFrames)
+		throw std::runtime_error("VidGraphics: frames layout doesn't match the data");
+
+	std::memcpy(palette.data(), payload.data(), sizeof(palette));
+	data = payload.subspan(sizeof(palette));
+
+	frames = frameLocations | std::views::transform([this](const FrameLocation& location) {
+		if (location.offset > data.size() || location.size > data.size() - location.offset)
+			throw std::overflow_error("VidGraphics: frame is out of data");
+
+		return Frame{.data = data.subspan(location.offset, location.size), .parent = this};
+	}) | std::ranges::to<std::vector>();
+
+	buildRowsIndex();
+}
+
+std::vector<VidGraphics::FrameLocation> VidGraphics::locateFrames(const VidGraphicsHeader& header, std::span<const std::byte> payload) {
+	if (header.dataSize < sizeof(palette) || payload.size() != header.dataSize)
+		throw std::runtime_error("VidGraphics: data size doesn't match the header");
+
+	// Same walk as the decoding constructor does, offsets are relative to the pixel data
+	const auto pixelData = payload.subspan(sizeof(palette));
+	SpanStreamReader frameDataReader{pixelData};
+	std::vector<FrameLocation> locations(header.numOfFrames);
+	for (auto& location : locations) {
+		const auto payloadSize = frameDataReader.read<std::uint32_t>() - 2;
+		const auto referenceFrameNumber = frameDataReader.read<std::uint16_t>();
+
+		if (referenceFrameNumber == 0xFFFF) {
+			location.offset = static_cast<std::uint32_t>(pixelData.size() - frameDataReader.bytesRemaining());
+			location.size = payloadSize;
+			frameDataReader.skip(payloadSize);
+		} else {
+			location = locations.at(referenceFrameNumber);
+		}
+	}
+
+	return locations;
+}
+
+void VidGraphics::buildRowsIndex() {
+	if (!isRowCompressedFormat(dataFormat))
+		return;
+
+	// Spans are set after all the offsets are collected, the vector doesn't reallocate anymore then
+	std::vector<std::size_t> framesRowsBegin;
+	framesRowsBegin.reserve(frames.size() + 1);
+	for (const auto& frame : frames) {
+		framesRowsBegin.push_back(rowOffsets.size());
+		const auto frameRowOffsets = indexFrameRows(dataFormat, frame.data);
+		rowOffsets.insert(rowOffsets.end(), frameRowOffsets.begin(), frameRowOffsets.end());
+	}
+	framesRowsBegin.push_back(rowOffsets.size());
+
+	for (std::size_t i = 0; i < frames.size(); ++i) {
+		frames[i].rowOffsets = std::span{rowOffsets}.subspan(framesRowsBegin[i], framesRowsBegin[i + 1] - framesRowsBegin[i]);
+	}
 }
 
 AdjacencyData getAdjacencyData(const Section& section, BinaryStreamReader reader) {
@@ -0,0 +1,265 @@
+export module Gromada.ResourcesCache;
+
+import std;
+import Gromada.ResourceReader;
+import Gromada.Resources;
+import Gromada.Resources.Sound;
+
+// Sidecar file with already parsed resources: vid properties, graphics frames layout, adjacency data and sound headers.
+// Everything is stored as flat arrays of trivially copyable records, so loading is a handful of memcpy's.
+// Graphics and sound samples aren't copied, the cache only points into the resource file.
+export struct ResourcesCacheData {
+	std::vector<Vid> vids;
+	std::optional<AdjacencyData> adjacencyData;
+	std::optional<std::vector<SoundData>> sounds;
+};
+
+// Returns nothing if there is no cache yet, or it's stale (doesn't match the resource file or the current layout)
+export std::optional<ResourcesCacheData> loadResourcesCache(
+	const std::filesystem::path& cachePath,
+	const std::filesystem::path& resourcePath,
+	const GromadaResourceNavigator& navigator,
+	GraphicsLoading graphicsLoading);
+
+// Lazily loaded graphics aren't decoded, their layout is known since the parsing (see LazyVidGraphics::Layout)
+export void saveResourcesCache(
+	const std::filesystem::path& cachePath,
+	const std::filesystem::path& resourcePath,
+	const GromadaResourceNavigator& navigator,
+	std::span<const Vid> vids,
+	const AdjacencyData* adjacencyData);
+
+
+// Implementation
+namespace {
+	constexpr std::array<char, 8> cacheMagic {'G', 'R', 'E', 'S', 'C', 'A', 'C', 'H'};
+	constexpr std::uint32_t cacheVersion = 1;
+
+	struct VidRecord {
+		VidProperties properties;
+		VidGraphicsHeader graphicsHeader;
+		std::uint32_t firstFrame;
+		std::uint64_t graphicsOffset; // of the palette in the resource file, 0 for the nvid-referenced vids
+	};
+
+	struct SoundRecord {
+		SoundHeader header;
+		std::uint64_t dataOffset;
+	};
+
+	struct CacheHeader {
+		std::array<char, 8> magic;
+		std::uint32_t version;
+		std::uint32_t layoutSignature;
+
+		std::uint64_t resourceSize;
+		std::int64_t resourceModificationTime;
+		std::uint64_t sectionsHash;
+
+		std::uint32_t numVids;
+		std::uint32_t numFrames;
+		std::uint32_t numAdjacencyValues; // UINT32_MAX if there is no adjacency data
+		std::uint32_t numSounds; // UINT32_MAX if there are no sounds
+	};
+
+	static_assert(std::is_trivially_copyable_v<VidRecord>);
+	static_assert(std::is_trivially_copyable_v<SoundRecord>);
+	static_assert(std::is_trivially_copyable_v<VidGraphics::FrameLocation>);
+
+	constexpr std::uint32_t absent = std::numeric_limits<std::uint32_t>::max();
+
+	// Records are stored as is, so any change of their layout or the host's byte order invalidates the cache
+	constexpr std::uint32_t layoutSignature() {
+		std::uint32_t hash = 2166136261u;
+		for (const std::size_t value : {sizeof(CacheHeader), sizeof(VidRecord), alignof(VidRecord), sizeof(VidProperties), sizeof(VidGraphicsHeader),
+		                                sizeof(VidGraphics::FrameLocation), sizeof(SoundRecord), alignof(SoundRecord), sizeof(SoundHeader),
+		                                static_cast<std::size_t>(std::endian::native == std::endian::little)}) {
+			hash = (hash ^ static_cast<std::uint32_t>(value)) * 16777619u;
+		}
+
+		return hash;
+	}
+
+	// Cheap fingerprint of the resource file's contents: every section's header and position
+	std::uint64_t hashSections(std::span<const Section> sections) {
+		std::uint64_t hash = 14695981039346656037ull;
+		const auto combine = [&](std::uint64_t value) {
+			for (int i = 0; i < 8; ++i, value >>= 8)
+				hash = (hash ^ (value & 0xFF)) * 1099511628211ull;
+		};
+
+		for (const auto& section : sections) {
+			const auto& header = section.header();
+			combine(std::to_underlying(header.type));
+			combine(header.nextSectionOffset);
+			combine(header.elementCount);
+			combine(header.dataOffset);
+			combine(static_cast<std::uint64_t>(static_cast<std::streamoff>(section.beginPos())));
+		}
+
+		return hash;
+	}
+
+	CacheHeader makeHeader(const std::filesystem::path& resourcePath, const GromadaResourceNavigator& navigator) {
+		CacheHeader header{};
+		header.magic = cacheMagic;
+		header.version = cacheVersion;
+		header.layoutSignature = layoutSignature();
+		header.resourceSize = navigator.mapping()->size();
+		header.resourceModificationTime = std::filesystem::last_write_time(resourcePath).time_since_epoch().count();
+		header.sectionsHash = hashSections(navigator.getSections());
+
+		return header;
+	}
+
+	bool isSameResource(const CacheHeader& a, const CacheHeader& b) {
+		return a.magic == b.magic && a.version == b.version && a.layoutSignature == b.layoutSignature &&
+		       a.resourceSize == b.resourceSize && a.resourceModificationTime == b.resourceModificationTime && a.sectionsHash == b.sectionsHash;
+	}
+
+	template <typename T>
+	std::vector<T> readRecords(BinaryStreamReader& reader, std::size_t count) {
+		if (count > reader.bytesRemaining() / sizeof(T))
+			throw std::overflow_error("ResourcesCache: too many records");
+
+		std::vector<T> records(count);
+		reader.read_to(std::as_writable_bytes(std::span{records}));
+		return records;
+	}
+
+	template <typename T>
+	void writeRecords(std::ostream& stream, std::span<const T> records) {
+		stream.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size_bytes()));
+	}
+}
+
+std::optional<ResourcesCacheData> loadResourcesCache(
+	const std::filesystem::path& cachePath,
+	const std::filesystem::path& resourcePath,
+	const GromadaResourceNavigator& navigator,
+	GraphicsLoading graphicsLoading) try {
+	if (!navigator.mapping() || !std::filesystem::exists(cachePath))
+		return std::nullopt;
+
+	const MappedFile cacheFile{cachePath};
+	BinaryStreamReader reader{cacheFile.bytes(), std::streampos{0}};
+
+	const auto header = reader.read<CacheHeader>();
+	if (!isSameResource(header, makeHeader(resourcePath, navigator)))
+		return std::nullopt;
+
+	const auto vidRecords = readRecords<VidRecord>(reader, header.numVids);
+	const auto frameLocations = readRecords<VidGraphics::FrameLocation>(reader, header.numFrames);
+
+	ResourcesCacheData result;
+	if (header.numAdjacencyValues != absent)
+		result.adjacencyData = AdjacencyData{readRecords<std::int16_t>(reader, header.numAdjacencyValues)};
+
+	const auto resourceData = navigator.mapping()->bytes();
+	if (header.numSounds != absent) {
+		result.sounds = readRecords<SoundRecord>(reader, header.numSounds) | std::views::transform([&](const SoundRecord& record) {
+			const auto dataBegin = static_cast<std::streampos>(static_cast<std::streamoff>(record.dataOffset));
+			return SoundData{record.header, StreamSpan{dataBegin, static_cast<std::streamoff>(record.header.dataSize)}.view(resourceData)};
+		}) | std::ranges::to<std::vector>();
+	}
+
+	result.vids.reserve(vidRecords.size());
+	for (const auto& record : vidRecords) {
+		if (record.properties.dataSizeOrNvid < 0) {
+			result.vids.emplace_back(record.properties, std::int32_t{-record.properties.dataSizeOrNvid});
+			continue;
+		}
+
+		const auto& graphicsHeader = record.graphicsHeader;
+		if (record.firstFrame > frameLocations.size() || graphicsHeader.numOfFrames > frameLocations.size() - record.firstFrame)
+			throw std::overflow_error("ResourcesCache: frames are out of range");
+
+		const auto graphicsBegin = static_cast<std::streampos>(static_cast<std::streamoff>(record.graphicsOffset));
+		const auto payload = StreamSpan{graphicsBegin, static_cast<std::streamoff>(graphicsHeader.dataSize)}.view(resourceData);
+		const auto vidFrameLocations = std::span{frameLocations}.subspan(record.firstFrame, graphicsHeader.numOfFrames);
+
+		result.vids.emplace_back(record.properties, graphicsLoading == GraphicsLoading::Lazy
+			? std::make_shared<const LazyVidGraphics>(graphicsHeader, std::make_shared<const LazyVidGraphics::Layout>(LazyVidGraphics::Layout{payload, {vidFrameLocations.begin(), vidFrameLocations.end()}}))
+			: std::make_shared<const LazyVidGraphics>(std::make_shared<const VidGraphics>(graphicsHeader, payload, vidFrameLocations)));
+	}
+
+	return result;
+} catch (const std::exception&) {
+	// Broken cache is the same as a missing one, it'll be rebuilt
+	return std::nullopt;
+}
+
+void saveResourcesCache(
+	const std::filesystem::path& cachePath,
+	const std::filesystem::path& resourcePath,
+	const GromadaResourceNavigator& navigator,
+	std::span<const Vid> vids,
+	const AdjacencyData* adjacencyData) {
+	if (!navigator.mapping())
+		return;
+
+	const auto resourceData = navigator.mapping()->bytes();
+	auto header = makeHeader(resourcePath, navigator);
+
+	std::vector<VidRecord> vidRecords;
+	std::vector<VidGraphics::FrameLocation> frameLocations;
+	vidRecords.reserve(vids.size());
+	for (const auto& vid : vids) {
+		VidRecord record{.properties = vid, .graphicsHeader = {}, .firstFrame = 0, .graphicsOffset = 0};
+		if (vid.dataSizeOrNvid >= 0) {
+			// Eagerly loaded graphics are decoded already, their layout is taken from the frames
+			const auto* lazyGraphics = std::get<Vid::Graphics>(vid.graphicsData).get();
+			const auto* layout = lazyGraphics->layout();
+			const auto payload = layout ? layout->payload : std::span{vid.graphics().data.data() - sizeof(VidGraphics::palette), vid.graphicsHeader().dataSize};
+
+			const auto payloadOffset = reinterpret_cast<std::uintptr_t>(payload.data()) - reinterpret_cast<std::uintptr_t>(resourceData.data());
+			if (payloadOffset > resourceData.size() || payload.size() > resourceData.size() - payloadOffset)
+				throw std::logic_error("ResourcesCache: graphics don't refer to the resource file");
+
+			record.graphicsHeader = lazyGraphics->header();
+			record.graphicsOffset = payloadOffset;
+			record.firstFrame = static_cast<std::uint32_t>(frameLocations.size());
+			if (layout) {
+				frameLocations.insert(frameLocations.end(), layout->frameLocations.begin(), layout->frameLocations.end());
+			} else {
+				const auto& graphics = vid.graphics();
+				for (const auto& frame : graphics.frames)
+					frameLocations.push_back(graphics.frameLocation(frame));
+			}
+		}
+
+		vidRecords.push_back(record);
+	}
+
+	std::vector<SoundRecord> soundRecords;
+	bool hasSounds = false;
+	for (const auto& section : navigator.getSections() | std::views::filter([](const Section& section) { return section.header().type == SectionType::Sound; })) {
+		auto reader = section.beginRead(resourceData);
+		soundRecords = locateSounds(section, reader) | std::views::transform([](const SoundLocation& location) {
+			return SoundRecord{location.header, location.dataOffset};
+		}) | std::ranges::to<std::vector>();
+		hasSounds = true;
+	}
+
+	header.numVids = static_cast<std::uint32_t>(vidRecords.size());
+	header.numFrames = static_cast<std::uint32_t>(frameLocations.size());
+	header.numAdjacencyValues = adjacencyData ? static_cast<std::uint32_t>(adjacencyData->data.size()) : absent;
+	header.numSounds = hasSounds ? static_cast<std::uint32_t>(soundRecords.size()) : absent;
+
+	// Written aside and renamed, so the cache is never seen half-written
+	auto temporaryPath = cachePath;
+	temporaryPath += ".tmp";
+	{
+		std::ofstream stream{temporaryPath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc};
+		stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+		writeRecords<CacheHeader>(stream, std::span{&header, 1});
+		writeRecords<VidRecord>(stream, vidRecords);
+		writeRecords<VidGraphics::FrameLocation>(stream, frameLocations);
+		if (adjacencyData)
+			writeRecords<std::int16_t>(stream, adjacencyData->data);
+		writeRecords<SoundRecord>(stream, soundRecords);
+	}
+
+	std::filesystem::rename(temporaryPath, cachePath);
+}
@@ -7,6 +7,24 @@ import std;
 import Gromada.ResourceReader;
 import utils;
 
+// Order matches SoundData::waveData alternatives
+export enum class SampleFormat : std::uint8_t {
+    Float32,
+    UInt8,
+    Int16,
+};
+
+// RIFF header of a sound, everything except the samples themselves
+export struct SoundHeader {
+    std::uint16_t numChannels {};
+    std::uint32_t sampleRate {};
+    SampleFormat sampleFormat {};
+    std::uint32_t dataSize {}; // 0 when there is no data chunk
+
+    // Leaves the reader at the beginning of the samples data
+    static SoundHeader read(BinaryStreamReader& reader);
+};
+
 // Actually, it's a usual wav
 export struct SoundData {
     std::uint16_t numChannels;
@@ -14,17 +32,31 @@ export struct SoundData {
     std::variant<std::vector<float>, std::vector<std::uint8_t>, std::vector<std::int16_t>> waveData;
 
     explicit SoundData (BinaryStreamReader& reader);
+    SoundData (const SoundHeader& header, std::span<const std::byte> samples);
+
+private:
+    // Returns bytes of the new buffer, suitable for the header's format and size
+    std::span<std::byte> allocateWaveData (const SoundHeader& header);
+};
+
+// Position of the sound's samples data in the whole file
+export struct SoundLocation {
+    SoundHeader header;
+    std::uint64_t dataOffset;
 };
 
 export std::vector<SoundData> getSounds( const Section& soundSection, BinaryStreamReader& soundReader);
+// Parses only headers, skipping the samples
+export std::vector<SoundLocation> locateSounds( const Section& soundSection, BinaryStreamReader& soundReader);
 
 
 // Implementation
-std::vector<SoundData> getSounds( const Section& soundSection, BinaryStreamReader& soundReader) {
+template <typename T>
+std::vector<T> readSoundSection( const Section& soundSection, BinaryStreamReader& soundReader, std::invocable<BinaryStreamReader&> auto readSound) {
     if(soundSection.header().type != SectionType::Sound)
         throw std::logic_error("Trying to get sounds with invalid section");
 
-    std::vector<SoundData> result;
+    std::vector<T> result;
     result.reserve(soundSection.header().elementCount);
 
     for (int i = 0; i < soundSection.header().elementCount; ++i) {
@@ -32,7 +64,7 @@ std::vector<SoundData> getSounds( const Section& soundSection, BinaryStreamReade
         const auto offset = soundReader.read<std::uint32_t>();
 
         const auto soundDataStartPos = soundReader.tellg();
-        result.emplace_back(soundReader);
+        result.push_back(readSound(soundReader));
         const auto numBytesRead = soundReader.tellg() - soundDataStartPos;
         if (numBytesRead > offset) {
             throw std::logic_error("Sound data read exceeds expected offset");
@@ -43,12 +75,28 @@ std::vector<SoundData> getSounds( const Section& soundSection, BinaryStreamReade
     return result;
 }
 
-SoundData::SoundData( BinaryStreamReader& reader ) {
+std::vector<SoundData> getSounds( const Section& soundSection, BinaryStreamReader& soundReader) {
+    return readSoundSection<SoundData>(soundSection, soundReader, [](BinaryStreamReader& reader) { return SoundData{reader}; });
+}
+
+std::vector<SoundLocation> locateSounds( const Section& soundSection, BinaryStreamReader& soundReader) {
+    return readSoundSection<SoundLocation>(soundSection, soundReader, [](BinaryStreamReader& reader) {
+        const auto header = SoundHeader::read(reader);
+        const auto dataOffset = static_cast<std::uint64_t>(static_cast<std::streamoff>(reader.tellg()));
+        reader.skip(header.dataSize);
+
+        return SoundLocation{header, dataOffset};
+    });
+}
+
+SoundHeader SoundHeader::read( BinaryStreamReader& reader ) {
     constexpr std::uint32_t riffMagic = 0x46464952; // "RIFF" in little-endian
     constexpr std::uint32_t waveMagic = 0x45564157; // "WAVE" in little-endian
     constexpr std::uint32_t fmtMagic  = 0x20746D66; // "fmt " in little-endian
     constexpr std::uint32_t dataMagic = 0x61746164; // "data" in little-endian
 
+    SoundHeader header;
+
     // WAV header parsing
     std::uint32_t riff_val = reader.read<std::uint32_t>();
     if (riff_val != riffMagic) throw std::runtime_error("Not a RIFF file");
@@ -65,8 +113,8 @@ SoundData::SoundData( BinaryStreamReader& reader ) {
         std::uint32_t chunk_size = reader.read<std::uint32_t>();
         if (chunk_id == fmtMagic) {
             audio_format = reader.read<std::uint16_t>();
-            numChannels = reader.read<std::uint16_t>();
-            sampleRate = reader.read<std::uint32_t>();
+            header.numChannels = reader.read<std::uint16_t>();
+            header.sampleRate = reader.read<std::uint32_t>();
             [[maybe_unused]]auto byteRate = reader.read<std::uint32_t>();
             [[maybe_unused]] auto blockAlign = reader.read<std::uint16_t>();
 
@@ -83,25 +131,54 @@ SoundData::SoundData( BinaryStreamReader& reader ) {
         std::uint32_t chunk_id = reader.read<std::uint32_t>();
         std::uint32_t chunk_size = reader.read<std::uint32_t>();
 
-        auto readData = [&]<typename T>(T _) {
-            auto& buffer = waveData.emplace<std::vector<T>>( chunk_size / sizeof(T) );
-            reader.read_to( std::as_writable_bytes(std::span{buffer}) );
-        };
-
         if (chunk_id == dataMagic) {
             if (audio_format == 3 && bits_per_sample == 32) {
-                readData(std::float_t{});
+                header.sampleFormat = SampleFormat::Float32;
             } else if (audio_format == 1 && bits_per_sample == 8) {
-                readData(std::uint8_t{});
+                header.sampleFormat = SampleFormat::UInt8;
             } else if (audio_format == 1 && bits_per_sample == 16) {
-                readData(std::int16_t{});
+                header.sampleFormat = SampleFormat::Int16;
             } else {
                 throw std::runtime_error("Unsupported audio format in WAV file");
             }
 
-            return;
+            header.dataSize = chunk_size;
+            return header;
         } else {
             reader.skip(chunk_size);
         }
     }
+
+    return header;
+}
+
+SoundData::SoundData( BinaryStreamReader& reader ) {
+    const auto header = SoundHeader::read(reader);
+    numChannels = header.numChannels;
+    sampleRate = header.sampleRate;
+    reader.read_to(allocateWaveData(header));
+}
+
+SoundData::SoundData( const SoundHeader& header, std::span<const std::byte> samples )
+    : numChannels{header.numChannels}
+    , sampleRate{header.sampleRate} {
+    const auto buffer = allocateWaveData(header);
+    if (samples.size() < buffer.size())
+        throw std::overflow_error("Not enough sound data");
+
+    std::ranges::copy(samples.first(buffer.size()), buffer.begin());
+}
+
+std::span<std::byte> SoundData::allocateWaveData( const SoundHeader& header ) {
+    const auto allocate = [&]<typename T>(std::type_identity<T>) {
+        return std::as_writable_bytes(std::span{waveData.emplace<std::vector<T>>(header.dataSize / sizeof(T))});
+    };
+
+    switch (header.sampleFormat) {
+        case SampleFormat::Float32: return allocate(std::type_identity<float>{});
+        case SampleFormat::UInt8: return allocate(std::type_identity<std::uint8_t>{});
+        case SampleFormat::Int16: return allocate(std::type_identity<std::int16_t>{});
+    }
+
+    throw std::logic_error("Unknown sample format");
 }
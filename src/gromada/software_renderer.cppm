@@ -1,6 +1,12 @@
 module;
 #include <cassert>
 
+// SSE2 is the baseline of x86-64, so it needs no runtime dispatch
+#if defined(__SSE2__) || defined(_M_X64)
+#define GROMADA_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
 export module Gromada.SoftwareRenderer;
 
 import std;
@@ -12,8 +18,39 @@ import Gromada.GraphicsDecoder;
 export struct RGBA8 : ColorRgb8 {
     std::uint8_t a = 255;
 };
+static_assert(sizeof(RGBA8) == sizeof(std::uint32_t));
 export using FramebufferRef = std::mdspan<RGBA8, std::dextents<int, 2>>;
+
+// Image in the memory the sprites are drawn to, doesn't need any graphics API
+export class PixelBuffer {
+public:
+    PixelBuffer() = default;
+    PixelBuffer(int width, int height)
+        : m_data(static_cast<std::size_t>(width) * height, RGBA8{0, 0, 0, 0})
+        , m_view{m_data.data(), std::dextents<int, 2>{height, width}} {}
+
+    // The view points to the data, which is only kept in place by moves
+    PixelBuffer(const PixelBuffer&) = delete;
+    PixelBuffer& operator=(const PixelBuffer&) = delete;
+    PixelBuffer(PixelBuffer&&) noexcept = default;
+    PixelBuffer& operator=(PixelBuffer&&) noexcept = default;
+
+    [[nodiscard]] int width() const noexcept { return m_view.extent(1); }
+    [[nodiscard]] int height() const noexcept { return m_view.extent(0); }
+
+    [[nodiscard]] std::span<RGBA8> pixels() noexcept { return m_data; }
+    [[nodiscard]] std::span<const RGBA8> pixels() const noexcept { return m_data; }
+
+    operator FramebufferRef() noexcept { return m_view; }
+
+private:
+    std::vector<RGBA8> m_data;
+    FramebufferRef m_view;
+};
+
 export void DrawSprite(const VidGraphics::Frame& frame, int x, int y, FramebufferRef framebuffer);
+// Draws only the part of the sprite inside clip_rect, which must lie within the framebuffer
+export void DrawSprite(const VidGraphics::Frame& frame, int x, int y, FramebufferRef framebuffer, BoundingBox clip_rect);
 
 
 // Implementation
@@ -31,17 +68,143 @@ constexpr std::uint8_t multiply(std::uint8_t a, std::uint8_t factor) {
 }
 
 
+constexpr auto multiplyTable = [] {
+    std::array<std::array<std::uint8_t, 256>, 8> table {};
+    for (int factor = 0; factor < 8; ++factor)
+        for (int a = 0; a < 256; ++a)
+            table[factor][a] = multiply(a, factor);
+
+    return table;
+}();
+
+
+// Span kernels, the vectorized paths give exactly the same results as lerp and multiply.
+// Pixels are processed as 32-bit little-endian words, so r, g, b, a are bytes 0..3
+#ifdef GROMADA_USE_SSE2
+const __m128i OpaqueAlpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+// floor((a * rem + b * mult) / 0x10000) in 16-bit lanes, the carry of the low halves' sum is added separately
+__m128i LerpLanes(__m128i a, __m128i b, __m128i rem, __m128i mult) noexcept {
+    const __m128i lowA = _mm_mullo_epi16(a, rem);
+    const __m128i lowB = _mm_mullo_epi16(b, mult);
+    const __m128i lowSum = _mm_add_epi16(lowA, lowB);
+    const __m128i carry = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_adds_epu16(lowA, lowB), lowSum), _mm_set1_epi16(1));
+
+    return _mm_add_epi16(_mm_add_epi16(_mm_mulhi_epu16(a, rem), _mm_mulhi_epu16(b, mult)), carry);
+}
+#endif
+
+void ShadePixels(std::span<RGBA8> pixels) noexcept {
+    std::size_t i = 0;
+#ifdef GROMADA_USE_SSE2
+    const __m128i mask = _mm_set1_epi32(0x00C3C3C3);
+    for (; i + 4 <= pixels.size(); i += 4) {
+        auto* data = reinterpret_cast<__m128i*>(pixels.data() + i);
+        _mm_storeu_si128(data, _mm_or_si128(_mm_and_si128(_mm_loadu_si128(data), mask), OpaqueAlpha));
+    }
+#endif
+
+    for (; i < pixels.size(); ++i) {
+        constexpr std::uint8_t ShadowMask = 0b11000011;
+        const auto oldColor = pixels[i];
+        pixels[i] = {static_cast<std::uint8_t>(oldColor.r & ShadowMask), static_cast<std::uint8_t>(oldColor.g & ShadowMask),
+            static_cast<std::uint8_t>(oldColor.b & ShadowMask), 255};
+    }
+}
+
+void LightPixels(std::span<RGBA8> pixels, std::uint8_t r, std::uint8_t g, std::uint8_t b) noexcept {
+    assert(r < 8 && g < 8 && b < 8);
+
+    std::size_t i = 0;
+#ifdef GROMADA_USE_SSE2
+    // (a * 8) / (8 - factor) is mulhi(a * 8, ceil(0x10000 / divisor)), except the divisor 1 which doesn't fit into 16 bits
+    const auto magic = [](std::uint8_t factor) { const int divisor = 8 - factor; return static_cast<short>(divisor == 1 ? 0 : (0x10000 + divisor - 1) / divisor); };
+    const auto isIdentity = [](std::uint8_t factor) { return static_cast<short>(factor == 7 ? -1 : 0); };
+    const __m128i multipliers = _mm_setr_epi16(magic(r), magic(g), magic(b), 0, magic(r), magic(g), magic(b), 0);
+    const __m128i identityMask = _mm_setr_epi16(isIdentity(r), isIdentity(g), isIdentity(b), 0, isIdentity(r), isIdentity(g), isIdentity(b), 0);
+    const __m128i zero = _mm_setzero_si128();
+
+    const auto multiplyLanes = [&](__m128i channels) {
+        const __m128i scaled = _mm_slli_epi16(channels, 3);
+        const __m128i quotient = _mm_mulhi_epu16(scaled, multipliers);
+        return _mm_or_si128(_mm_andnot_si128(identityMask, quotient), _mm_and_si128(identityMask, scaled));
+    };
+
+    for (; i + 4 <= pixels.size(); i += 4) {
+        auto* data = reinterpret_cast<__m128i*>(pixels.data() + i);
+        const __m128i source = _mm_loadu_si128(data);
+        // Saturating pack does the clamping to 255
+        const __m128i result = _mm_packus_epi16(multiplyLanes(_mm_unpacklo_epi8(source, zero)), multiplyLanes(_mm_unpackhi_epi8(source, zero)));
+        _mm_storeu_si128(data, _mm_or_si128(result, OpaqueAlpha));
+    }
+#endif
+
+    for (; i < pixels.size(); ++i) {
+        const auto src = pixels[i];
+        pixels[i] = {multiplyTable[r][src.r], multiplyTable[g][src.g], multiplyTable[b][src.b], 255};
+    }
+}
+
+void BlendIndexedPixels(std::span<RGBA8> pixels, std::span<const IndexedColor> colors, std::span<const ColorRgb8, 256> palette, std::uint8_t t) noexcept {
+    assert(pixels.size() <= colors.size());
+
+    std::size_t i = 0;
+#ifdef GROMADA_USE_SSE2
+    // Lerp's factors don't fit into 16 bits at the ends of the range, these are left to the scalar code
+    if (t != 0 && t != 255) {
+        const int mult = 0x10000 * t / 255;
+        const __m128i multLanes = _mm_set1_epi16(static_cast<short>(mult));
+        const __m128i remLanes = _mm_set1_epi16(static_cast<short>(0x10000 - mult));
+        const __m128i zero = _mm_setzero_si128();
+
+        const auto sourcePixel = [&](std::size_t index) {
+            const auto color = palette[std::to_underlying(colors[index])];
+            return static_cast<int>(color.r | (color.g << 8) | (color.b << 16));
+        };
+
+        for (; i + 4 <= pixels.size(); i += 4) {
+            auto* data = reinterpret_cast<__m128i*>(pixels.data() + i);
+            const __m128i source = _mm_setr_epi32(sourcePixel(i), sourcePixel(i + 1), sourcePixel(i + 2), sourcePixel(i + 3));
+            const __m128i destination = _mm_loadu_si128(data);
+
+            const __m128i low = LerpLanes(_mm_unpacklo_epi8(source, zero), _mm_unpacklo_epi8(destination, zero), remLanes, multLanes);
+            const __m128i high = LerpLanes(_mm_unpackhi_epi8(source, zero), _mm_unpackhi_epi8(destination, zero), remLanes, multLanes);
+            _mm_storeu_si128(data, _mm_or_si128(_mm_packus_epi16(low, high), OpaqueAlpha));
+        }
+    }
+#endif
+
+    for (; i < pixels.size(); ++i) {
+        const auto srcColor = palette[std::to_underlying(colors[i])];
+        const auto dstColor = pixels[i];
+        pixels[i] = {lerp(srcColor.r, dstColor.r, t), lerp(srcColor.g, dstColor.g, t), lerp(srcColor.b, dstColor.b, t), 255};
+    }
+}
+
+
+// Unclipped variant requires the whole sprite to be inside the framebuffer, it writes runs as is
+template <bool Clipped>
 struct SoftwareRendererVisitor {
     int x0, y0;
     std::span<const ColorRgb8, 256> palette;
     FramebufferRef framebuffer;
+    BoundingBox clip_rect; // in the framebuffer coordinates
     BoundingBox source_rect; // just for validation purposes
     int x = 0, y = 0;
+    // Visible part of the sprite in the framebuffer coordinates, from the clipping info
+    int visible_begin_x = 0, visible_end_x = 0, visible_begin_y = 0, visible_end_y = 0;
 
     [[nodiscard]] ClippingInfo begin_image(BoundingBox source_rect) noexcept {
         this->source_rect = source_rect;
-        const BoundingBox destination_rect {-x0, framebuffer.extent(1)-x0, -y0, framebuffer.extent(0)-y0};
-        return {source_rect, destination_rect};
+        const BoundingBox destination_rect = clip_rect.getTranslated(-x0, -y0);
+        const ClippingInfo clipping_info {source_rect, destination_rect};
+        assert(Clipped || (clipping_info.skip_first_x == 0 && clipping_info.skip_last_x == 0 && clipping_info.skip_first_y == 0 && clipping_info.skip_last_y == 0));
+
+        visible_begin_x = x0 + clipping_info.skip_first_x;
+        visible_end_x = x0 + clipping_info.last_x;
+        visible_begin_y = y0 + clipping_info.skip_first_y;
+        visible_end_y = y0 + clipping_info.last_y;
+        return clipping_info;
     }
 
     void set_cursor(int cursor_x, int cursor_y) noexcept {
@@ -56,65 +219,63 @@ struct SoftwareRendererVisitor {
     }
 
     void draw_pixels_shadow(int count) noexcept {
-        for_clipped_pixels( count, [&](int x, int i) {
-            constexpr std::uint8_t ShadowMask = 0b11000011;
-            auto oldColor = framebuffer[y, x];
-            framebuffer[y, x] = {static_cast<std::uint8_t>(oldColor.r & ShadowMask), static_cast<std::uint8_t>(oldColor.g & ShadowMask),
-                static_cast<std::uint8_t>(oldColor.b & ShadowMask), 255};
+        for_clipped_pixels( count, [](std::span<RGBA8> pixels, int) {
+            ShadePixels(pixels);
         });
     }
 
     void draw_pixels_indexed(std::span<const IndexedColor> colors_data) noexcept {
-        for_clipped_pixels(colors_data.size(), [=](int x, int i) {
-            const auto color_index = std::to_underlying(colors_data[i]);
-            framebuffer[y, x] = RGBA8{palette[color_index], 255};
+        for_clipped_pixels(colors_data.size(), [this, colors_data](std::span<RGBA8> pixels, int first) {
+            std::ranges::transform(colors_data.subspan(first, pixels.size()), pixels.begin(), [this](IndexedColor color_index) {
+                return RGBA8{palette[std::to_underlying(color_index)], 255};
+            });
         });
     }
 
     void draw_pixels(std::span<const CompressedColor> colors_data) noexcept {
-        for_clipped_pixels(colors_data.size(), [&](int x, int i) {
-            framebuffer[y, x] = RGBA8{colors_data[i].to_rgb8(), 255};
+        for_clipped_pixels(colors_data.size(), [colors_data](std::span<RGBA8> pixels, int first) {
+            std::ranges::transform(colors_data.subspan(first, pixels.size()), pixels.begin(), [](CompressedColor color) {
+                return RGBA8{color.to_rgb8(), 255};
+            });
         });
     }
 
     void draw_pixels_repeat(int count, IndexedColor color_index) noexcept {
-        for_clipped_pixels( count, [this, color = RGBA8{palette[std::to_underlying(color_index)], 255}](int x, int i) {
-            framebuffer[y, x] = color;
+        for_clipped_pixels( count, [color = RGBA8{palette[std::to_underlying(color_index)], 255}](std::span<RGBA8> pixels, int) {
+            std::ranges::fill(pixels, color);
         });
     }
 
     void draw_pixels_repeat(int count, CompressedColor color) noexcept {
-        for_clipped_pixels( count, [this, color = RGBA8{color.to_rgb8(), 255}](int x, int i) {
-            framebuffer[y, x] = color;
+        for_clipped_pixels( count, [color = RGBA8{color.to_rgb8(), 255}](std::span<RGBA8> pixels, int) {
+            std::ranges::fill(pixels, color);
         });
     }
 
     void draw_pixels_light(int count, std::uint8_t r, std::uint8_t g, std::uint8_t b) noexcept {
-        for_clipped_pixels( count, [&](int x, int i) {
-            const auto src = framebuffer[y, x];
-
-            framebuffer[y, x] = {multiply(src.r, r), multiply(src.g, g), multiply(src.b, b) , 255};
+        for_clipped_pixels( count, [=](std::span<RGBA8> pixels, int) {
+            LightPixels(pixels, r, g, b);
         });
     }
 
     void draw_pixels_alpha_blend(std::uint8_t t, std::span<const std::byte> colors_data) noexcept {
-        for_clipped_pixels(colors_data.size(), [&](int x, int i) {
-            const auto color_index = static_cast<std::uint8_t>(colors_data[i]);
-            const auto srcColor = RGBA8{palette[color_index], 255};
-            const auto dstColor = framebuffer[y, x];
-            framebuffer[y, x] = {lerp(srcColor.r, dstColor.r, t), lerp(srcColor.g, dstColor.g, t), lerp(srcColor.b, dstColor.b, t), 255};
+        for_clipped_pixels(colors_data.size(), [this, t, colors_data](std::span<RGBA8> pixels, int first) {
+            BlendIndexedPixels(pixels, colors_data.subspan(first), palette, t);
         });
     }
 
 private:
+    // Calls callback(pixels, first) with the visible part of the run in the current framebuffer row, first is its index in the run
     void for_clipped_pixels( int count, auto callback) noexcept {
-        if (y < 0 || y >= framebuffer.extent(0)) {
-            return; // Out of bounds
-        }
-
-        int end_x = std::min(x + count, framebuffer.extent(1));
-        for (int destination_x = std::max(x, 0); destination_x <  end_x; ++destination_x) {
-            callback(destination_x, destination_x - x);
+        if constexpr (Clipped) {
+            const int begin_x = std::max(x, visible_begin_x);
+            const int end_x = std::min(x + count, visible_end_x);
+            if (y >= visible_begin_y && y < visible_end_y && begin_x < end_x) {
+                callback(std::span{&framebuffer[y, begin_x], static_cast<std::size_t>(end_x - begin_x)}, begin_x - x);
+            }
+        } else {
+            assert(y >= 0 && y < framebuffer.extent(0) && x >= 0 && x + count <= framebuffer.extent(1));
+            callback(std::span{&framebuffer[y, x], static_cast<std::size_t>(count)}, 0);
         }
 
         advance_cursor(count);
@@ -122,14 +283,23 @@ private:
 };
 
 void DrawSprite(const VidGraphics::Frame& frame, int x, int y, FramebufferRef framebuffer) {
+    DrawSprite(frame, x, y, framebuffer, {0, framebuffer.extent(1), 0, framebuffer.extent(0)});
+}
+
+void DrawSprite(const VidGraphics::Frame& frame, int x, int y, FramebufferRef framebuffer, BoundingBox clip_rect) {
     assert(x > std::numeric_limits<int>::min() / 2 && y > std::numeric_limits<int>::min() / 2);
     assert(x < std::numeric_limits<int>::max() / 2 && y < std::numeric_limits<int>::max() / 2);
+    assert(clip_rect.left >= 0 && clip_rect.top >= 0 && clip_rect.right <= framebuffer.extent(1) && clip_rect.down <= framebuffer.extent(0));
 
     const VidGraphics& data = *frame.parent;
-    if (x + data.width <= 0 || y + data.height <= 0 || x >= framebuffer.extent(1) || y >= framebuffer.extent(0)) {
+    if (x + data.width <= clip_rect.left || y + data.height <= clip_rect.top || x >= clip_rect.right || y >= clip_rect.down) {
         return;
     }
 
-    SoftwareRendererVisitor renderer{x, y, std::span{data.palette}, framebuffer};
-    DecodeFrame(frame, renderer);
-}
\ No newline at end of file
+    // Most of the sprites are entirely visible, they don't need any clipping
+    if (x >= clip_rect.left && y >= clip_rect.top && x + data.width <= clip_rect.right && y + data.height <= clip_rect.down) {
+        DecodeFrame(frame, SoftwareRendererVisitor<false>{x, y, std::span{data.palette}, framebuffer, clip_rect});
+    } else {
+        DecodeFrame(frame, SoftwareRendererVisitor<true>{x, y, std::span{data.palette}, framebuffer, clip_rect});
+    }
+}
@@ -51,4 +51,9 @@ export std::optional<std::pair<std::size_t, std::size_t>> getAnimationFrameRange
 export std::optional<std::pair<std::size_t, std::size_t>> getAnimationFrameRange(const Vid& vid, Action action, std::uint8_t direction) {
 	const auto directionIndex = getDirectionIndex(vid.directionsCount, direction);
 	return getAnimationFrameRangeDirIndex(vid, action, directionIndex).or_else( [&] { return getAnimationFrameRangeDirIndex(vid, Action::act_stand, directionIndex); });
-}
\ No newline at end of file
+}
+
+// Sprites are drawn in order of z_layer, then of this depth
+export int getDrawingDepth(const Vid& vid, int y, int z) {
+	return y + vid.graphicsHeader().height / 10 + z;
+}
@@ -6,6 +6,7 @@
 #include <cassert>
 
 import application;
+import batch_modes;
 import std;
 
 class SappWrapper {
@@ -68,5 +69,12 @@ public:
 };
 
 sapp_desc sokol_main(int argc, char* argv[]) {
+	// Batch jobs don't need a window, they're done before sokol_app creates one
+	const std::vector<std::string> args {argv, argv + argc};
+	if (const auto exitCode = runBatchRender(args)
+		.or_else([&] { return runBatchGenerate(args); })
+		.or_else([&] { return runBatchValidate(args); }))
+		std::exit(*exitCode);
+
 	return SappWrapper::create(argc, argv);
 }
@@ -0,0 +1,119 @@
+module;
+#include <cerrno>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+export module mapped_file;
+
+import std;
+
+// Read-only view of a whole file mapped into the address space.
+// Pages are loaded on demand by the OS and shared between processes mapping the same file.
+export class MappedFile {
+public:
+	explicit MappedFile(const std::filesystem::path& path);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	[[nodiscard]] std::span<const std::byte> bytes() const noexcept { return {m_data, m_size}; }
+	[[nodiscard]] std::size_t size() const noexcept { return m_size; }
+
+private:
+	const std::byte* m_data = nullptr;
+	std::size_t m_size = 0;
+};
+
+
+// Implementation
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+	const auto throwError = [&](DWORD error, std::string_view what) {
+		throw std::system_error(static_cast<int>(error), std::system_category(), std::format("{} {}", what, path.generic_string()));
+	};
+
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throwError(GetLastError(), "Failed to open");
+
+	LARGE_INTEGER fileSize{};
+	if (!GetFileSizeEx(file, &fileSize)) {
+		const auto error = GetLastError();
+		CloseHandle(file);
+		throwError(error, "Failed to get size of");
+	}
+
+	m_size = static_cast<std::size_t>(fileSize.QuadPart);
+	if (m_size == 0) {
+		CloseHandle(file);
+		return;
+	}
+
+	// The view keeps the mapping object alive, so both handles may be closed right away
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const auto mappingError = GetLastError();
+	CloseHandle(file);
+	if (!mapping)
+		throwError(mappingError, "Failed to create mapping of");
+
+	m_data = static_cast<const std::byte*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	const auto viewError = GetLastError();
+	CloseHandle(mapping);
+	if (!m_data)
+		throwError(viewError, "Failed to map");
+}
+
+MappedFile::~MappedFile() {
+	if (m_data)
+		UnmapViewOfFile(m_data);
+}
+
+#else
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+	const auto throwError = [&](int error, std::string_view what) {
+		throw std::system_error(error, std::generic_category(), std::format("{} {}", what, path.generic_string()));
+	};
+
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		throwError(errno, "Failed to open");
+
+	struct stat fileStat {};
+	if (::fstat(fd, &fileStat) != 0) {
+		const int error = errno;
+		::close(fd);
+		throwError(error, "Failed to get size of");
+	}
+
+	m_size = static_cast<std::size_t>(fileStat.st_size);
+	if (m_size == 0) {
+		::close(fd);
+		return;
+	}
+
+	void* data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	const int mapError = errno;
+	::close(fd);
+	if (data == MAP_FAILED)
+		throwError(mapError, "Failed to map");
+
+	m_data = static_cast<const std::byte*>(data);
+}
+
+MappedFile::~MappedFile() {
+	if (m_data)
+		::munmap(const_cast<std::byte*>(m_data), m_size);
+}
+
+#endif
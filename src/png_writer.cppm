@@ -0,0 +1,198 @@
+module;
+#include <cassert>
+
+export module png_writer;
+
+import std;
+
+// Writes 8-bit RGBA image as PNG. Pixel data isn't compressed (stored deflate blocks), that's enough for previews
+export void savePng(const std::filesystem::path& path, int width, int height, std::span<const std::byte> rgba);
+
+export struct PngImage {
+	int width = 0;
+	int height = 0;
+	std::vector<std::byte> rgba;
+};
+
+// Reads back the images written by savePng, PNG files with compressed data (as most of the others are) aren't supported
+export PngImage loadPng(const std::filesystem::path& path);
+
+
+// Implementation
+namespace {
+	constexpr auto crcTable = [] {
+		std::array<std::uint32_t, 256> table {};
+		for (std::uint32_t i = 0; i < table.size(); ++i) {
+			std::uint32_t value = i;
+			for (int bit = 0; bit < 8; ++bit)
+				value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+			table[i] = value;
+		}
+		return table;
+	}();
+
+	std::uint32_t updateCrc(std::uint32_t crc, std::span<const std::byte> data) noexcept {
+		for (const auto byte : data)
+			crc = crcTable[(crc ^ std::to_integer<std::uint32_t>(byte)) & 0xFF] ^ (crc >> 8);
+		return crc;
+	}
+
+	class PngStream {
+	public:
+		explicit PngStream(const std::filesystem::path& path) : m_stream{path, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc} {
+			m_stream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+		}
+
+		void writeChunk(std::string_view type, std::span<const std::byte> data) {
+			assert(type.size() == 4);
+			writeBigEndian(static_cast<std::uint32_t>(data.size()));
+			const auto typeBytes = std::as_bytes(std::span{type});
+			write(typeBytes);
+			write(data);
+			writeBigEndian(~updateCrc(updateCrc(0xFFFFFFFFu, typeBytes), data));
+		}
+
+		void write(std::span<const std::byte> data) { m_stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size())); }
+
+		void writeBigEndian(std::uint32_t value) {
+			const auto bytes = std::bit_cast<std::array<std::byte, 4>>(std::endian::native == std::endian::little ? std::byteswap(value) : value);
+			write(bytes);
+		}
+
+	private:
+		std::ofstream m_stream;
+	};
+
+	void appendBigEndian(std::vector<std::byte>& out, std::uint32_t value) {
+		for (int shift = 24; shift >= 0; shift -= 8)
+			out.push_back(static_cast<std::byte>(value >> shift));
+	}
+
+	std::uint32_t readBigEndian(std::span<const std::byte> data, std::size_t offset) {
+		if (offset + 4 > data.size())
+			throw std::runtime_error("loadPng: unexpected end of file");
+
+		std::uint32_t value = 0;
+		for (std::size_t i = 0; i < 4; ++i)
+			value = value << 8 | std::to_integer<std::uint32_t>(data[offset + i]);
+		return value;
+	}
+}
+
+void savePng(const std::filesystem::path& path, int width, int height, std::span<const std::byte> rgba) {
+	if (width <= 0 || height <= 0 || rgba.size() != static_cast<std::size_t>(width) * height * 4)
+		throw std::invalid_argument("savePng: image size doesn't match the data");
+
+	// Every row starts with the filter type, 0 means no filter
+	const auto rowSize = static_cast<std::size_t>(width) * 4;
+	std::vector<std::byte> scanlines;
+	scanlines.reserve((rowSize + 1) * height);
+	for (int y = 0; y < height; ++y) {
+		scanlines.push_back(std::byte{0});
+		const auto row = rgba.subspan(y * rowSize, rowSize);
+		scanlines.insert(scanlines.end(), row.begin(), row.end());
+	}
+
+	// zlib stream of stored blocks, each up to 64K
+	constexpr std::size_t maxBlockSize = 0xFFFF;
+	std::vector<std::byte> zlib {std::byte{0x78}, std::byte{0x01}};
+	zlib.reserve(scanlines.size() + scanlines.size() / maxBlockSize * 5 + 16);
+	for (std::size_t offset = 0; offset < scanlines.size(); offset += maxBlockSize) {
+		const auto blockSize = std::min(maxBlockSize, scanlines.size() - offset);
+		const bool isLast = offset + blockSize == scanlines.size();
+		const auto length = static_cast<std::uint16_t>(blockSize);
+		zlib.insert(zlib.end(), {std::byte{isLast}, static_cast<std::byte>(length), static_cast<std::byte>(length >> 8),
+		                         static_cast<std::byte>(~length), static_cast<std::byte>(~length >> 8)});
+		zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + blockSize);
+	}
+
+	std::uint32_t a = 1, b = 0;
+	for (const auto byte : scanlines) {
+		a = (a + std::to_integer<std::uint32_t>(byte)) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendBigEndian(zlib, (b << 16) | a);
+
+	std::vector<std::byte> header;
+	appendBigEndian(header, static_cast<std::uint32_t>(width));
+	appendBigEndian(header, static_cast<std::uint32_t>(height));
+	header.insert(header.end(), {std::byte{8}, std::byte{6}, std::byte{0}, std::byte{0}, std::byte{0}}); // 8 bits per channel, RGBA
+
+	PngStream stream{path};
+	constexpr std::array signature {std::byte{0x89}, std::byte{'P'}, std::byte{'N'}, std::byte{'G'}, std::byte{'\r'}, std::byte{'\n'}, std::byte{0x1A}, std::byte{'\n'}};
+	stream.write(signature);
+	stream.writeChunk("IHDR", header);
+	stream.writeChunk("IDAT", zlib);
+	stream.writeChunk("IEND", {});
+}
+
+PngImage loadPng(const std::filesystem::path& path) {
+	std::ifstream stream{path, std::ios_base::in | std::ios_base::binary};
+	stream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+	std::vector<std::byte> file(std::filesystem::file_size(path));
+	stream.read(reinterpret_cast<char*>(file.data()), static_cast<std::streamsize>(file.size()));
+
+	constexpr std::size_t signatureSize = 8;
+	if (file.size() < signatureSize || file[1] != std::byte{'P'} || file[2] != std::byte{'N'} || file[3] != std::byte{'G'})
+		throw std::runtime_error("loadPng: not a PNG file");
+
+	PngImage image;
+	std::vector<std::byte> zlib;
+	for (std::size_t offset = signatureSize; offset < file.size();) {
+		const auto length = readBigEndian(file, offset);
+		if (offset + 12 + length > file.size())
+			throw std::runtime_error("loadPng: unexpected end of file");
+
+		const std::string_view type {reinterpret_cast<const char*>(file.data() + offset + 4), 4};
+		const auto data = std::span{file}.subspan(offset + 8, length);
+		if (type == "IHDR") {
+			image.width = static_cast<int>(readBigEndian(data, 0));
+			image.height = static_cast<int>(readBigEndian(data, 4));
+			constexpr std::array rgba8 {std::byte{8}, std::byte{6}, std::byte{0}, std::byte{0}, std::byte{0}};
+			if (data.size() != 13 || !std::ranges::equal(data.subspan(8), rgba8))
+				throw std::runtime_error("loadPng: only non-interlaced 8-bit RGBA images are supported");
+		} else if (type == "IDAT") {
+			zlib.insert(zlib.end(), data.begin(), data.end());
+		} else if (type == "IEND") {
+			break;
+		}
+		offset += 12 + length;
+	}
+
+	const auto rowSize = static_cast<std::size_t>(image.width) * 4;
+	if (image.width <= 0 || image.height <= 0 || rowSize * image.height > file.size())
+		throw std::runtime_error("loadPng: invalid image size");
+
+	// Stored blocks follow the 2-byte zlib header, every block's header takes a whole byte
+	std::vector<std::byte> scanlines;
+	scanlines.reserve((rowSize + 1) * image.height);
+	for (std::size_t offset = 2, isLast = 0; !isLast;) {
+		if (offset + 5 > zlib.size())
+			throw std::runtime_error("loadPng: unexpected end of data");
+
+		const auto blockHeader = std::to_integer<std::uint8_t>(zlib[offset]);
+		if ((blockHeader & 0b110) != 0)
+			throw std::runtime_error("loadPng: compressed images are not supported");
+
+		isLast = blockHeader & 1;
+		const auto length = std::to_integer<std::size_t>(zlib[offset + 1]) | std::to_integer<std::size_t>(zlib[offset + 2]) << 8;
+		if (offset + 5 + length > zlib.size())
+			throw std::runtime_error("loadPng: unexpected end of data");
+
+		scanlines.insert(scanlines.end(), zlib.begin() + offset + 5, zlib.begin() + offset + 5 + length);
+		offset += 5 + length;
+	}
+
+	if (scanlines.size() != (rowSize + 1) * image.height)
+		throw std::runtime_error("loadPng: image size doesn't match the data");
+
+	image.rgba.reserve(rowSize * image.height);
+	for (int y = 0; y < image.height; ++y) {
+		const auto row = std::span{scanlines}.subspan(y * (rowSize + 1), rowSize + 1);
+		if (row.front() != std::byte{0})
+			throw std::runtime_error("loadPng: filtered images are not supported");
+		image.rgba.insert(image.rgba.end(), row.begin() + 1, row.end());
+	}
+
+	return image;
+}
@@ -0,0 +1,157 @@
+module;
+#include <flecs.h>
+
+export module profiler;
+
+import std;
+import nlohmann.json;
+
+// Collects named time zones of every frame: totals of the last frames are kept for the histograms,
+// and the zones themselves for export as Chrome trace events (chrome://tracing, ui.perfetto.dev)
+export class Profiler {
+public:
+	using Clock = std::chrono::steady_clock;
+	static constexpr std::size_t historyLength = 240; // in frames
+	static constexpr std::size_t traceLength = 300; // in frames
+
+	// Total time of the zones with the same name, per frame
+	struct Timeline {
+		std::string_view name;
+		std::array<float, historyLength> milliseconds {};
+	};
+
+	static Profiler& shared();
+
+	// Thread-safe, zones of the worker threads go to their own lines of the trace
+	void addZone(const char* name, Clock::time_point begin, Clock::time_point end);
+	// Called once per frame by the main loop, the zones added after it are the next frame's
+	void endFrame();
+
+	[[nodiscard]] std::span<const Timeline> timelines() const noexcept { return m_timelines; }
+	// Timelines are ring buffers, the oldest frame is at this index
+	[[nodiscard]] std::size_t historyOffset() const noexcept { return m_numFrames % historyLength; }
+
+	void writeChromeTrace(std::ostream& stream) const;
+
+private:
+	struct Zone {
+		const char* name;
+		Clock::time_point begin, end;
+		std::uint32_t threadIndex;
+	};
+
+	Timeline& timeline(std::string_view name);
+
+	const Clock::time_point m_epoch = Clock::now();
+	Clock::time_point m_frameBegin = m_epoch;
+	std::size_t m_numFrames = 0;
+
+	std::mutex m_mutex;
+	std::vector<Zone> m_currentZones;
+
+	std::vector<Timeline> m_timelines;
+	std::deque<std::vector<Zone>> m_frames;
+};
+
+// Adds a zone of its lifetime to the shared profiler
+export class ProfileScope {
+public:
+	explicit ProfileScope(const char* name) noexcept : m_name{name}, m_begin{Profiler::Clock::now()} {}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+	~ProfileScope() { Profiler::shared().addZone(m_name, m_begin, Profiler::Clock::now()); }
+
+private:
+	const char* m_name;
+	Profiler::Clock::time_point m_begin;
+};
+
+// Run callback for the flecs systems with each(): world.system<...>().run(profiledRun("name")).each(...)
+export auto profiledRun(const char* name) {
+	return [name](flecs::iter& it) {
+		const ProfileScope scope{name};
+		while (it.next())
+			it.each();
+	};
+}
+
+// Same for the systems with detect_changes(): the tables which haven't changed since the previous run are skipped, and aren't marked as written
+export auto changedTablesRun(const char* name) {
+	return [name](flecs::iter& it) {
+		const ProfileScope scope{name};
+		while (it.next()) {
+			if (!it.changed()) {
+				it.skip();
+				continue;
+			}
+			it.each();
+		}
+	};
+}
+
+
+// Implementation
+namespace {
+	std::uint32_t currentThreadIndex() {
+		static std::atomic<std::uint32_t> numThreads = 0;
+		thread_local const std::uint32_t index = numThreads++;
+		return index;
+	}
+}
+
+Profiler& Profiler::shared() {
+	static Profiler profiler;
+	return profiler;
+}
+
+void Profiler::addZone(const char* name, Clock::time_point begin, Clock::time_point end) {
+	const auto threadIndex = currentThreadIndex();
+	std::scoped_lock lock{m_mutex};
+	m_currentZones.push_back({name, begin, end, threadIndex});
+}
+
+void Profiler::endFrame() {
+	const auto frameEnd = Clock::now();
+	std::vector<Zone> zones;
+	{
+		std::scoped_lock lock{m_mutex};
+		zones = std::exchange(m_currentZones, {});
+	}
+	zones.push_back({"Frame", m_frameBegin, frameEnd, currentThreadIndex()});
+	m_frameBegin = frameEnd;
+
+	const auto slot = m_numFrames++ % historyLength;
+	for (auto& timeline : m_timelines)
+		timeline.milliseconds[slot] = 0.0f;
+	for (const auto& zone : zones)
+		timeline(zone.name).milliseconds[slot] += std::chrono::duration<float, std::milli>{zone.end - zone.begin}.count();
+
+	m_frames.push_back(std::move(zones));
+	if (m_frames.size() > traceLength)
+		m_frames.pop_front();
+}
+
+Profiler::Timeline& Profiler::timeline(std::string_view name) {
+	const auto it = std::ranges::find(m_timelines, name, &Timeline::name);
+	return it != m_timelines.end() ? *it : m_timelines.emplace_back(Timeline{.name = name});
+}
+
+void Profiler::writeChromeTrace(std::ostream& stream) const {
+	const auto microseconds = [](Clock::duration duration) { return std::chrono::duration<double, std::micro>{duration}.count(); };
+
+	auto events = nlohmann::json::array();
+	for (const auto& frame : m_frames) {
+		for (const auto& zone : frame) {
+			events.push_back({
+				{"name", zone.name},
+				{"ph", "X"},
+				{"ts", microseconds(zone.begin - m_epoch)},
+				{"dur", microseconds(zone.end - zone.begin)},
+				{"pid", 0},
+				{"tid", zone.threadIndex},
+			});
+		}
+	}
+
+	stream << nlohmann::json{{"traceEvents", std::move(events)}, {"displayTimeUnit", "ms"}};
+}
@@ -0,0 +1,162 @@
+export module thread_pool;
+
+import std;
+
+// Fixed-size pool of worker threads.
+// Without threads support (e.g. Emscripten build without pthreads) it has no workers and all the work runs inline.
+export class ThreadPool {
+public:
+	explicit ThreadPool(std::size_t numThreads = defaultThreadCount());
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	~ThreadPool();
+
+	[[nodiscard]] std::size_t size() const noexcept { return m_workers.size(); }
+
+	template <std::invocable Fn>
+	std::future<std::invoke_result_t<Fn>> submit(Fn&& fn) {
+		// std::function requires copyable callables, so the task is shared
+		auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Fn>()>>(std::forward<Fn>(fn));
+		auto future = task->get_future();
+		enqueue([task = std::move(task)] { (*task)(); });
+
+		return future;
+	}
+
+	// Calls fn(i) for every i in [0, count) and blocks until all of them are done, the calling thread takes part in the work too.
+	// If some calls have failed, rethrows the exception of the lowest index, as a sequential loop would do.
+	void parallelFor(std::size_t count, std::invocable<std::size_t> auto&& fn);
+
+	static ThreadPool& shared();
+	static std::size_t defaultThreadCount() noexcept;
+
+private:
+	void enqueue(std::function<void()> task);
+	void workerLoop(std::stop_token stopToken);
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable_any m_condition;
+	std::deque<std::function<void()>> m_tasks;
+	std::vector<std::jthread> m_workers;
+};
+
+
+// Implementation
+void ThreadPool::parallelFor(std::size_t count, std::invocable<std::size_t> auto&& fn) {
+	if (count == 0)
+		return;
+
+	if (m_workers.empty() || count == 1) {
+		for (std::size_t i = 0; i < count; ++i)
+			fn(i);
+		return;
+	}
+
+	// Helpers may start after all the work is done (and the caller returned), so the state is shared
+	// and fn is only touched while there are unfinished indices
+	struct State {
+		std::atomic<std::size_t> nextIndex = 0;
+		std::atomic<std::size_t> numFinished = 0;
+		std::atomic<std::size_t> failedIndex = std::numeric_limits<std::size_t>::max();
+		std::exception_ptr error;
+		std::mutex errorMutex;
+	};
+	auto state = std::make_shared<State>();
+
+	const auto work = [count, &fn](State& state) {
+		for (std::size_t i; (i = state.nextIndex.fetch_add(1, std::memory_order_relaxed)) < count;) {
+			// Everything after the failed index is skipped, its result would be thrown away anyway
+			if (i < state.failedIndex.load(std::memory_order_relaxed)) {
+				try {
+					fn(i);
+				}
+				catch (...) {
+					std::scoped_lock lock{state.errorMutex};
+					if (i < state.failedIndex.load(std::memory_order_relaxed)) {
+						state.failedIndex.store(i, std::memory_order_relaxed);
+						state.error = std::current_exception();
+					}
+				}
+			}
+
+			if (state.numFinished.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+				state.numFinished.notify_all();
+		}
+	};
+
+	const auto numHelpers = std::min(m_workers.size(), count - 1);
+	for (std::size_t i = 0; i < numHelpers; ++i)
+		enqueue([state, work] { work(*state); });
+
+	work(*state);
+	for (std::size_t finished; (finished = state->numFinished.load(std::memory_order_acquire)) != count;)
+		state->numFinished.wait(finished, std::memory_order_acquire);
+
+	// Take the error out, so the exception isn't released by a late helper holding the state
+	std::exception_ptr error;
+	{
+		std::scoped_lock lock{state->errorMutex};
+		error = std::exchange(state->error, nullptr);
+	}
+	if (error)
+		std::rethrow_exception(error);
+}
+
+ThreadPool::ThreadPool(std::size_t numThreads) {
+	m_workers.reserve(numThreads);
+	for (std::size_t i = 0; i < numThreads; ++i)
+		m_workers.emplace_back([this](std::stop_token stopToken) { workerLoop(stopToken); });
+}
+
+ThreadPool::~ThreadPool() {
+	for (auto& worker : m_workers)
+		worker.request_stop();
+
+	m_condition.notify_all();
+	m_workers.clear();
+}
+
+ThreadPool& ThreadPool::shared() {
+	static ThreadPool pool;
+	return pool;
+}
+
+std::size_t ThreadPool::defaultThreadCount() noexcept {
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+	return 0;
+#else
+	// The thread that waits for results usually does a part of the work itself
+	const auto hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+#endif
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+	if (m_workers.empty()) {
+		task();
+		return;
+	}
+
+	{
+		std::scoped_lock lock{m_mutex};
+		m_tasks.push_back(std::move(task));
+	}
+	m_condition.notify_one();
+}
+
+void ThreadPool::workerLoop(std::stop_token stopToken) {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock lock{m_mutex};
+			if (!m_condition.wait(lock, stopToken, [this] { return !m_tasks.empty(); }))
+				return;
+
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+
+		task();
+	}
+}
@@ -14,8 +14,74 @@ export {
 		{ t.bytesRemaining() } -> std::convertible_to<std::size_t>;
 	};
 
+	// Converts a value read as is from the little-endian data to the host byte order
+	template <typename T>
+	requires std::is_trivially_copyable_v<T>
+	constexpr void from_little_endian(T& value) noexcept {
+		if constexpr (std::endian::native == std::endian::little) {
+			return;
+		}
+		else if constexpr (std::is_enum_v<T>) {
+			auto underlying = std::to_underlying(value);
+			from_little_endian(underlying);
+			value = static_cast<T>(underlying);
+		}
+		else if constexpr (std::is_integral_v<T>) {
+			value = std::byteswap(value);
+		}
+		else if constexpr (std::ranges::contiguous_range<T>) {
+			for (auto& element : value)
+				from_little_endian(element);
+		}
+		else {
+			static_assert(sizeof(T) == 0, "Unsupported type of a packed field");
+		}
+	}
+
+	// Describes a packed little-endian record of the file: the members of T in the order they are stored, without any padding.
+	// Such records are read in a single call and unpacked from the buffer, with no alignment requirements.
+	template <typename T, auto... Members>
+	requires (std::is_member_object_pointer_v<decltype(Members)> && ...)
+	struct PackedLayout {
+		using Type = T;
+		static constexpr std::size_t size = (sizeof(std::declval<T&>().*Members) + ...);
+
+		static void unpack(std::span<const std::byte, size> data, T& out) noexcept {
+			std::size_t offset = 0;
+			([&](auto& member) {
+				std::memcpy(&member, data.data() + offset, sizeof(member));
+				from_little_endian(member);
+				offset += sizeof(member);
+			}(out.*Members), ...);
+		}
+
+		// Byte swapping is symmetric, so the same conversion turns host values into little-endian ones
+		static void pack(const T& in, std::span<std::byte, size> data) noexcept {
+			std::size_t offset = 0;
+			([&](auto member) {
+				from_little_endian(member);
+				std::memcpy(data.data() + offset, &member, sizeof(member));
+				offset += sizeof(member);
+			}(in.*Members), ...);
+		}
+	};
+
 	template <typename BaseType>
 	struct StreamReaderMixin {
+		template <typename Layout>
+		void read_packed(typename Layout::Type& out) {
+			std::array<std::byte, Layout::size> buffer;
+			self().read_to(std::span{buffer});
+			Layout::unpack(buffer, out);
+		}
+
+		template <typename Layout>
+		[[nodiscard]] Layout::Type read_packed() {
+			typename Layout::Type result;
+			read_packed<Layout>(result);
+			return result;
+		}
+
 		template <typename T>
 		requires std::is_trivially_copyable_v<T>
 		void read_to(T& out) {
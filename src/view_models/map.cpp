@@ -14,6 +14,7 @@ export module application.view_model : map;
 import std;
 import framebuffer;
 import imgui_utils;
+import profiler;
 import utils;
 
 import application.model;
@@ -43,9 +44,10 @@ export class MapViewModel {
 
         world.system<Framebuffer, const Viewport>()
             .kind(flecs::PreUpdate)
+            .run(profiledRun("Framebuffer resize"))
             .each([](Framebuffer& framebuffer, const Viewport& viewport) {
+                // Level renderer clears and redraws only the changed parts, so the image isn't cleared here
                 framebuffer.resize(viewport.viewportSize);
-                framebuffer.clear({0, 0, 0, 0});
             });
 
 
@@ -92,6 +94,7 @@ export class MapViewModel {
             const auto step = 255 / static_cast<float>(prototype.get<const VidRef>()->directionsCount);
             prototype_transform.direction += (ImGui::GetIO().MouseWheel > 0 ? 1 : -1) * step;
         }
+        prototype.modified<Transform, Local>();
     }
 
     void onMenu() {
@@ -121,7 +124,10 @@ export class MapViewModel {
         ImDrawList* draw_list = ImGui::GetWindowDrawList();
         {
             Framebuffer& framebuffer = m_world.get_mut<Framebuffer>();
-            framebuffer.commitToGpu();
+            {
+                const ProfileScope scope{"Framebuffer::commitToGpu"};
+                framebuffer.commitToGpu();
+            }
 
             draw_list->AddImage(
                 simgui_imtextureid(framebuffer.getImage()), ImVec2{0, 0},
@@ -321,6 +327,7 @@ export class MapViewModel {
 
             transform_ls.x += static_cast<int>(delta_ws.x);
             transform_ls.y += static_cast<int>(delta_ws.y);
+            id.modified<Transform, Local>(); // for the change detection of the transform propagation
         });
         ImGui::ResetMouseDragDelta();
     }
@@ -1,50 +1,122 @@
 module;
 #include <imgui.h>
+#include <sokol_gfx.h>
+#include <util/sokol_imgui.h>
 
 
 export module application.view_model:map_selector;
 
 import std;
 import imgui_utils;
+import framebuffer;
+import png_writer;
+import sokol.helpers;
 
 import application.model;
+import Gromada.MapsIndex;
+import Gromada.SoftwareRenderer;
 
 export class MapsSelectorViewModel {
 public:
 	explicit MapsSelectorViewModel(Model& model)
-		: m_model{model}, m_mapsBaseDirectory{model.get<const GameResources>().mapsPath()} {}
+		: m_model{model}
+		, m_mapsIndex{model.get<const GameResources>(), model.get<const GameResources>().mapsPath(), std::filesystem::current_path() / "maps_index"} {}
 
 	void updateUI() {
 	    const auto activeLevel = m_model.component<ActiveLevel>();
+		if (m_mapsIndex.update())
+			m_thumbnailName.reset(); // it could be rendered just now
 
-		if (MyImUtils::ListBox("Maps", &m_selectedMap, std::span<const MapEntry>{m_maps}, MyImUtils::MakeSelectableCallback<const MapEntry&>(&MapEntry::name))) {
-			const auto& selectedMap = m_maps[m_selectedMap];
+		const auto maps = m_mapsIndex.maps();
+		if (ImGui::Button("Refresh")) {
+			const auto selectedName = m_selectedMap < static_cast<int>(maps.size()) ? std::optional{maps[m_selectedMap].name} : std::nullopt;
+			m_mapsIndex.refresh();
+			m_selectedMap = selectedName ? findMap(*selectedName).value_or(0) : 0;
+			m_thumbnailName.reset();
+		}
+		if (const auto numPending = m_mapsIndex.numPending(); numPending > 0) {
+			ImGui::SameLine();
+			ImGui::TextDisabled("indexing, %zu maps left", numPending);
+		}
+
+		constexpr float detailsHeight = 260.0f;
+		if (MyImUtils::ListBox("Maps", &m_selectedMap, m_mapsIndex.maps(), MyImUtils::MakeSelectableCallback<const MapSummary&>(&MapSummary::name), ImVec2{-FLT_MIN, -detailsHeight})) {
+			const auto& selectedMap = maps[m_selectedMap];
 			if (auto* currentPath = activeLevel.try_get<Path>(); !currentPath || (selectedMap.path != *currentPath)) {
-				m_model.loadMap(selectedMap.path);
+				m_model.loadMapAsync(selectedMap.path);
+			} else {
+				// Back to the map which is shown now
+				m_model.cancelMapLoading();
 			}
+
+			// Browsing goes up and down the list usually
+			std::vector<std::filesystem::path> neighbours;
+			if (m_selectedMap > 0)
+				neighbours.push_back(maps[m_selectedMap - 1].path);
+			if (m_selectedMap + 1 < static_cast<int>(maps.size()))
+				neighbours.push_back(maps[m_selectedMap + 1].path);
+			m_model.prefetchMaps(neighbours);
+		}
+
+		if (const auto* loading = m_model.mapLoading()) {
+			const auto name = loading->path.filename().string();
+			ImGui::ProgressBar(loading->progress->fraction.load(std::memory_order_relaxed), ImVec2{-FLT_MIN, 0.0f}, name.c_str());
+		} else if (const auto& error = m_model.mapLoadingError(); !error.empty()) {
+			ImGui::TextColored(ImVec4{1.0f, 0.3f, 0.3f, 1.0f}, "%s", error.c_str());
 		}
+
+		if (m_selectedMap < static_cast<int>(maps.size()))
+			showDetails(maps[m_selectedMap]);
 	}
 
 private:
-	Model& m_model;
-	int m_selectedMap = 0;
+	std::optional<int> findMap(const std::u8string& name) const {
+		const auto maps = m_mapsIndex.maps();
+		const auto it = std::ranges::find(maps, name, &MapSummary::name);
+		return it != maps.end() ? std::optional{static_cast<int>(it - maps.begin())} : std::nullopt;
+	}
 
-	struct MapEntry {
-		std::u8string name;
-		std::filesystem::path path;
-	};
+	void showDetails(const MapSummary& summary) {
+		if (!summary.isSummarized()) {
+			ImGui::TextDisabled("Not indexed yet");
+			return;
+		}
+		if (!summary.error.empty()) {
+			ImGui::TextColored(ImVec4{1.0f, 0.3f, 0.3f, 1.0f}, "%s", summary.error.c_str());
+			return;
+		}
 
-	static std::vector<MapEntry> getMaps(const Model& model, const std::filesystem::path& mapsDirectory) {
-		if (!std::filesystem::exists(mapsDirectory))
-			return {};
+		ImGui::Text("%u x %u, version %u", summary.header.width, summary.header.height, static_cast<unsigned>(summary.header.mapVersion));
+		ImGui::Text("%zu objects, %zu commands", summary.numObjects, summary.numCommands);
 
-		return std::filesystem::recursive_directory_iterator{mapsDirectory} | std::views::transform([&mapsDirectory](const auto& entry) {
-			return MapEntry{std::filesystem::relative(entry.path(), mapsDirectory).u8string(), entry.path()};
-		}) | std::views::filter([](const auto& entry) { return entry.path.extension() == ".map"; }) |
-			   std::ranges::to<std::vector>();
+		// Only the selected map's thumbnail is in the GPU memory
+		if (m_thumbnailName != summary.name) {
+			m_thumbnailName = summary.name;
+			m_thumbnail.reset();
+			try {
+				const auto image = loadPng(summary.thumbnail);
+				Framebuffer framebuffer{image.width, image.height};
+				std::ranges::copy(image.rgba, reinterpret_cast<std::byte*>(FramebufferRef{framebuffer}.data_handle()));
+				framebuffer.markDirty();
+				framebuffer.commitToGpu();
+				m_thumbnail = std::move(framebuffer).getImage();
+				m_thumbnailSize = {static_cast<float>(image.width), static_cast<float>(image.height)};
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Failed to load thumbnail " << summary.thumbnail.generic_string() << ": " << e.what() << std::endl;
+			}
+		}
+
+		if (m_thumbnail)
+			ImGui::Image(simgui_imtextureid(*m_thumbnail), m_thumbnailSize);
 	}
 
+private:
+	Model& m_model;
+	int m_selectedMap = 0;
 
-	std::filesystem::path m_mapsBaseDirectory;
-	std::vector<MapEntry> m_maps = getMaps(m_model, m_mapsBaseDirectory);
-};
\ No newline at end of file
+	MapsIndex m_mapsIndex;
+	std::optional<std::u8string> m_thumbnailName; // of the map whose thumbnail is loaded
+	std::optional<SgUniqueImageWithView> m_thumbnail;
+	ImVec2 m_thumbnailSize;
+};
@@ -0,0 +1,52 @@
+module;
+#include <imgui.h>
+#include <misc/cpp/imgui_stdlib.h>
+
+export module application.view_model:profiler_window;
+
+import std;
+import profiler;
+
+export class ProfilerWindowViewModel {
+public:
+	void updateUI(bool* open) {
+		ImGui::SetNextWindowPos({320, 20}, ImGuiCond_FirstUseEver);
+		ImGui::SetNextWindowSize(ImVec2{420, 600}, ImGuiCond_FirstUseEver);
+		if (!ImGui::Begin("Profiler", open)) {
+			ImGui::End();
+			return;
+		}
+
+		const auto& profiler = Profiler::shared();
+		ImGui::InputText("##trace path", &m_tracePath);
+		ImGui::SameLine();
+		if (ImGui::Button("Export trace")) {
+			std::ofstream stream{m_tracePath, std::ios_base::out | std::ios_base::trunc};
+			profiler.writeChromeTrace(stream);
+		}
+		ImGui::TextDisabled("Last %zu frames as Chrome trace events, open them in ui.perfetto.dev", Profiler::traceLength);
+		ImGui::Separator();
+
+		// Zones of a frame share the scale of the frame itself, so the histograms are comparable
+		const auto timelines = profiler.timelines();
+		float maxMilliseconds = 1.0f;
+		for (const auto& timeline : timelines)
+			maxMilliseconds = std::max(maxMilliseconds, std::ranges::max(timeline.milliseconds));
+
+		for (const auto& timeline : timelines) {
+			const auto& values = timeline.milliseconds;
+			const float average = std::ranges::fold_left(values, 0.0f, std::plus{}) / values.size();
+			const auto overlay = std::format("{}: avg {:.2f} ms, max {:.2f} ms", timeline.name, average, std::ranges::max(values));
+
+			ImGui::PushID(timeline.name.data());
+			ImGui::PlotHistogram("", values.data(), static_cast<int>(values.size()), static_cast<int>(profiler.historyOffset()),
+				overlay.c_str(), 0.0f, maxMilliseconds, ImVec2{-FLT_MIN, 40.0f});
+			ImGui::PopID();
+		}
+
+		ImGui::End();
+	}
+
+private:
+	std::string m_tracePath = "trace.json";
+};
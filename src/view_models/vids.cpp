@@ -25,7 +25,7 @@ import utils;
 auto makeComparator(const ImGuiTableSortSpecs& sortSpecs) {
 	constexpr static auto extractGraphicsGormat = [](const Vid& vid) {
 		const auto* graphics = std::get_if<Vid::Graphics>(&(vid.graphicsData));
-		return graphics ? graphics->get()->dataFormat : -1;
+		return graphics ? (*graphics)->header().dataFormat : -1;
 	};
 
 	const std::array comparators{
@@ -101,7 +101,7 @@ public:
 				ImGui::Text("%i", vid->behave);
 
 				ImGui::TableNextColumn();
-			    ImGui::Text("%i", vid->graphics().dataFormat);
+			    ImGui::Text("%i", vid->graphicsHeader().dataFormat);
 
 				ImGui::TableNextRow();
 			}
@@ -279,13 +279,14 @@ void VidsWindowViewModel::VidUI(const Vid& self) {
     std::visit(overloaded{
                    [](std::int32_t arg) { ImGui::Text("Source nVid: %i", arg); },
                    [&self](const Vid::Graphics& arg) {
+                       const auto& header = arg->header();
                        ImGui::Text("frames size: %i", self.dataSizeOrNvid);
-                       ImGui::Text("data format: %x", arg->dataFormat);
-                       ImGui::Text("frame duration: %ims (%i FPS)", arg->frameDuration, 1000 / arg->frameDuration);
-                       ImGui::Text("numOfFrames: %i", arg->numOfFrames);
-                       ImGui::Text("dataSize: %i", arg->dataSize);
-                       ImGui::Text("width: %i", arg->width);
-                       ImGui::Text("height: %i", arg->height);
+                       ImGui::Text("data format: %x", header.dataFormat);
+                       ImGui::Text("frame duration: %ims (%i FPS)", header.frameDuration, 1000 / header.frameDuration);
+                       ImGui::Text("numOfFrames: %i", header.numOfFrames);
+                       ImGui::Text("dataSize: %i", header.dataSize);
+                       ImGui::Text("width: %i", header.width);
+                       ImGui::Text("height: %i", header.height);
                    },
                },
         self.graphicsData);
@@ -298,9 +299,9 @@ void VidsWindowViewModel::ShowFramesWindow(const Vid& self) {
 	        return;
 	}
 
-	const auto framesData = std::get_if<Vid::Graphics>(&self.graphicsData);
+	const auto& graphicsHeader = self.graphicsHeader();
 	const auto ShowFrame = [&](size_t index) {
-		ImGui::Image(simgui_imtextureid(m_decodedFrames[index]), {static_cast<float>((*framesData)->width), static_cast<float>((*framesData)->height)});
+		ImGui::Image(simgui_imtextureid(m_decodedFrames[index]), {static_cast<float>(graphicsHeader.width), static_cast<float>(graphicsHeader.height)});
 	};
 
 
@@ -308,7 +309,7 @@ void VidsWindowViewModel::ShowFramesWindow(const Vid& self) {
 		ImGui::BeginTabBar( "FramesTabBar", ImGuiTabBarFlags_None);
 		if (ImGui::BeginTabItem( "All frames" )) {
 			ImGui::Checkbox( "Show numbers", &m_showFrameNumbers);
-			std::size_t imagesPerLine = std::max(1.0f, std::floor(ImGui::GetContentRegionAvail().x / (*framesData)->width));
+			std::size_t imagesPerLine = std::max(1.0f, std::floor(ImGui::GetContentRegionAvail().x / graphicsHeader.width));
 			for (int index = 0; index < m_decodedFrames.size(); ++index) {
 				auto pos = ImGui::GetCursorScreenPos();
 				ShowFrame(index);
@@ -336,7 +337,7 @@ void VidsWindowViewModel::ShowFramesWindow(const Vid& self) {
 			ImGui::Checkbox("Show animation", &m_framesWindowState.showAnimation);
 
 			if (ImGui::BeginChild( "FramesChild", {0, 0}, ImGuiChildFlags_None, ImGuiWindowFlags_HorizontalScrollbar)) {
-				m_framesWindowState.frameNumber += m_framesWindowState.stopwatch.advance(ImGui::GetIO().DeltaTime, self.graphics().frameDuration * 0.001f);
+				m_framesWindowState.frameNumber += m_framesWindowState.stopwatch.advance(ImGui::GetIO().DeltaTime, graphicsHeader.frameDuration * 0.001f);
 
 				for (std::size_t i = 0; i < 16; ++i) {
 					const auto frameRange = getAnimationFrameRangeDirIndex(self, static_cast<Action>(i), m_framesWindowState.direction);